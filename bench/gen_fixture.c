@@ -0,0 +1,149 @@
+/*
+ * gen_fixture.c
+ * Generate a synthetic proc tree for benchmarking ports: net/{tcp,tcp6,udp,udp6}
+ * in the kernel's text format plus <pid>/fd trees whose socket:[inode] links
+ * own those sockets, and a comm and stat file per pid.
+ *
+ * Usage: gen_fixture <root> <sockets> <pids>
+ *
+ * Sockets are spread over the four tables and handed to pids with a Zipf-like
+ * skew (pid k gets a share proportional to 1/(k+1)), so a few processes hold
+ * huge fd tables, as on real proxy hosts. One in ten TCP sockets listens,
+ * the rest are established; UDP sockets are unconnected (state 07). Every pid
+ * also holds a few non-socket fds. The generator is deterministic and skips
+ * the work when <root>/.scale already records the same scale.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define INODE_BASE 100000ul
+
+static void die(const char *what, const char *path) {
+    fprintf(stderr, "gen_fixture: %s %s: %s\n", what, path, strerror(errno));
+    exit(1);
+}
+
+static void mkdir_p(const char *path) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; ++p) {
+        if (*p != '/') continue;
+        *p = 0;
+        if (mkdir(tmp, 0755) < 0 && errno != EEXIST) die("mkdir", tmp);
+        *p = '/';
+    }
+    if (mkdir(tmp, 0755) < 0 && errno != EEXIST) die("mkdir", tmp);
+}
+
+// cheap deterministic PRNG (xorshift64*)
+static unsigned long long rng_state = 0x9E3779B97F4A7C15ull;
+static unsigned long long rng(void) {
+    rng_state ^= rng_state >> 12; rng_state ^= rng_state << 25; rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+static void write_table(const char *root, const char *name, bool v6, bool udp, size_t first, size_t n) {
+    char path[4096]; snprintf(path, sizeof(path), "%s/net/%s", root, name);
+    FILE *f = fopen(path, "w"); if (!f) die("open", path);
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+    if (v6)
+        fprintf(f, "  sl  local_address                         remote_address                        st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode\n");
+    else
+        fprintf(f, "  sl  local_address rem_address   st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode\n");
+
+    for (size_t i = 0; i < n; ++i) {
+        unsigned long inode = INODE_BASE + first + i;
+        unsigned lport, rport = 0, st;
+        if (udp) { st = 0x07; lport = 1024 + (unsigned)(rng() % 60000); }
+        else if (i % 10 == 0) { st = 0x0A; lport = 1024 + (unsigned)(i / 10 % 60000); }
+        else { st = 0x01; lport = 1024 + (unsigned)(rng() % 200); rport = 1024 + (unsigned)(rng() % 60000); }
+        unsigned laddr = (unsigned)rng(), raddr = st == 0x01 ? (unsigned)rng() : 0;
+
+        if (v6)
+            fprintf(f, "%4zu: 0000000000000000FFFF0000%08X:%04X 0000000000000000FFFF0000%08X:%04X %02X 00000000:00000000 00:00000000 00000000  1000        0 %lu 1 0000000000000000 100 0 0 10 0\n",
+                    i, laddr, lport, raddr, rport, st, inode);
+        else
+            fprintf(f, "%4zu: %08X:%04X %08X:%04X %02X 00000000:00000000 00:00000000 00000000  1000        0 %lu 1 0000000000000000 100 0 0 10 0\n",
+                    i, laddr, lport, raddr, rport, st, inode);
+    }
+    if (fclose(f) != 0) die("write", path);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) { fprintf(stderr, "usage: %s <root> <sockets> <pids>\n", argv[0]); return 2; }
+    const char *root = argv[1];
+    size_t nsock = strtoul(argv[2], NULL, 10), npids = strtoul(argv[3], NULL, 10);
+    if (!npids) npids = 1;
+
+    char path[4096], want[64];
+    snprintf(want, sizeof(want), "%zu %zu\n", nsock, npids);
+    snprintf(path, sizeof(path), "%s/.scale", root);
+    FILE *stamp = fopen(path, "r");
+    if (stamp) {
+        char have[64] = "";
+        bool same = fgets(have, sizeof(have), stamp) && strcmp(have, want) == 0;
+        fclose(stamp);
+        if (same) { printf("fixture %s already at %zu sockets / %zu pids\n", root, nsock, npids); return 0; }
+        fprintf(stderr, "gen_fixture: %s holds a different scale; remove it first\n", root);
+        return 1;
+    }
+
+    snprintf(path, sizeof(path), "%s/net", root);
+    mkdir_p(path);
+    size_t q = nsock / 4;
+    write_table(root, "tcp",  false, false, 0,     q);
+    write_table(root, "tcp6", true,  false, q,     q);
+    write_table(root, "udp",  false, true,  2 * q, q);
+    write_table(root, "udp6", true,  true,  3 * q, nsock - 3 * q);
+
+    // Zipf-like shares: pid k receives about nsock * (1/(k+1)) / H(npids)
+    double h = 0; for (size_t k = 0; k < npids; ++k) h += 1.0 / (double)(k + 1);
+    size_t next = 0;
+    for (size_t k = 0; k < npids; ++k) {
+        pid_t pid = (pid_t)(1000 + k);
+        size_t share = k + 1 == npids ? nsock - next : (size_t)((double)nsock / (double)(k + 1) / h);
+        if (next + share > nsock) share = nsock - next;
+
+        snprintf(path, sizeof(path), "%s/%d/fd", root, (int)pid);
+        mkdir_p(path);
+        snprintf(path, sizeof(path), "%s/%d/comm", root, (int)pid);
+        FILE *c = fopen(path, "w"); if (!c) die("open", path);
+        fprintf(c, "worker%zu\n", k % 50);
+        fclose(c);
+        // stat as the kernel formats it; only the start time (field 22) is read
+        snprintf(path, sizeof(path), "%s/%d/stat", root, (int)pid);
+        c = fopen(path, "w"); if (!c) die("open", path);
+        fprintf(c, "%d (worker%zu) S 1 %d %d 0 -1 4194560 0 0 0 0 0 0 0 0 20 0 1 0 %zu 0 0\n", (int)pid, k % 50, (int)pid, (int)pid, 1000 + k);
+        fclose(c);
+
+        char link[4096], target[64];
+        static const char *const other[] = { "/dev/null", "pipe:[4242]", "anon_inode:[eventpoll]" };
+        int fd = 0;
+        for (size_t o = 0; o < 3; ++o, ++fd) {
+            snprintf(link, sizeof(link), "%s/%d/fd/%d", root, (int)pid, fd);
+            if (symlink(other[o], link) < 0 && errno != EEXIST) die("symlink", link);
+        }
+        for (size_t i = 0; i < share; ++i, ++fd) {
+            snprintf(link, sizeof(link), "%s/%d/fd/%d", root, (int)pid, fd);
+            snprintf(target, sizeof(target), "socket:[%lu]", INODE_BASE + next + i);
+            if (symlink(target, link) < 0 && errno != EEXIST) die("symlink", link);
+        }
+        next += share;
+    }
+
+    snprintf(path, sizeof(path), "%s/.scale", root);
+    stamp = fopen(path, "w"); if (!stamp) die("open", path);
+    fputs(want, stamp);
+    fclose(stamp);
+    printf("fixture %s: %zu sockets / %zu pids\n", root, nsock, npids);
+    return 0;
+}
@@ -2,7 +2,7 @@
  * ports.c
  * List listening ports and the owning process (if possible), and allow searching
  * by port or process name. Parses /proc/net/* and maps socket inode -> pid.
- * Supports JSON output (-j), sorting (-s), and reverse (-r).
+ * Supports JSON output (-j, --ndjson), sorting (-s), and reverse (-r).
  *
  * Build: make
  * Usage:
@@ -18,225 +18,4040 @@
 #define _GNU_SOURCE
 
 #include <arpa/inet.h>
-#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <inttypes.h>
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/perf_event.h>
+#include <linux/sock_diag.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <regex.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
-typedef struct owner_info { pid_t pid; char name[256]; struct owner_info *next; } owner_info_t;
+// one record per process that owns at least one listed socket; the name is
+// read from /proc/<pid>/comm the first time the pid matches and then shared
+// name_gen/name_hit: the -n verdict on name, valid while name_gen is g_names.gen;
+// uid, cmdline and cgroup are only read for -o (else -1 and NULL)
+typedef struct proc_info {
+    pid_t pid; unsigned gen, name_gen; bool name_hit; char name[256];
+    uid_t uid; char *cmdline, *cgroup;
+    struct proc_info *next;
+} proc_info_t;
+typedef struct owner_info { proc_info_t *proc; struct owner_info *next; } owner_info_t;
 
-typedef struct sock_entry {
-    char proto[8];            // tcp/tcp6/udp/udp6
-    char local_hex[64];       // hex local address as in /proc/net
-    char local_ip[64];        // human readable IP
-    unsigned port;
-    unsigned long inode;
-    owner_info_t *owners;    // linked list of owners
-    struct sock_entry *next;
-} sock_entry_t;
+typedef enum { PROTO_TCP, PROTO_TCP6, PROTO_UDP, PROTO_UDP6 } proto_t;
+static const char *const proto_names[] = { "tcp", "tcp6", "udp", "udp6" };
+
+static inline bool proto_is_v6(proto_t p) { return p == PROTO_TCP6 || p == PROTO_UDP6; }
+static inline bool proto_is_udp(proto_t p) { return p == PROTO_UDP || p == PROTO_UDP6; }
+
+// the state shown without -a, as kernel TCP state numbers: LISTEN for TCP;
+// UDP has no listen state, a bound socket waiting for datagrams is CLOSE
+#define TCP_LISTEN_STATE 10  // TCP_LISTEN, "0A" in /proc/net
+#define UDP_UNCONN_STATE 7   // TCP_CLOSE, "07" in /proc/net
+static inline uint8_t listen_state(proto_t p) { return proto_is_udp(p) ? UDP_UNCONN_STATE : TCP_LISTEN_STATE; }
+
+// bump allocator: records are carved out of large blocks and released in one
+// shot by arena_free(), instead of one malloc/free per record
+typedef struct arena_block { struct arena_block *next; size_t used, size; max_align_t data[]; } arena_block_t;
+typedef struct { arena_block_t *blocks; } arena_t;
+
+#define ARENA_BLOCK_SIZE (256u * 1024u)
+
+static void *arena_alloc(arena_t *a, size_t size) {
+    size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+    arena_block_t *b = a->blocks;
+    if (!b || b->size - b->used < size) {
+        size_t bsize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        b = malloc(sizeof(*b) + bsize);
+        if (!b)
+            return NULL;
+        b->used = 0; b->size = bsize;
+        b->next = a->blocks;
+        a->blocks = b;
+    }
+    void *p = (char *)b->data + b->used;
+    b->used += size;
+    return p;
+}
+
+static void arena_free(arena_t *a) {
+    while (a->blocks) { arena_block_t *n = a->blocks->next; free(a->blocks); a->blocks = n; }
+}
+
+// -o: optional columns. The queue depths are per socket and kept in the
+// table only when asked for; the others are per process and read once per
+// owner record, when the owner scan creates it
+enum { COL_CMDLINE = 1u << 0, COL_UID = 1u << 1, COL_CGROUP = 1u << 2, COL_RXQ = 1u << 3, COL_TXQ = 1u << 4 };
+#define COL_QUEUES (COL_RXQ | COL_TXQ)
+#define COL_PROC   (COL_CMDLINE | COL_UID | COL_CGROUP)
+static unsigned g_cols = 0;
+static const char *const col_names[] = { "cmdline", "uid", "cgroup", "rxq", "txq" };
+
+// a comma separated list of col_names; 0 if one is unknown
+static unsigned parse_cols(const char *arg) {
+    unsigned cols = 0;
+    for (const char *w = arg; ; ) {
+        size_t len = strcspn(w, ","), c = 0;
+        while (c < sizeof(col_names) / sizeof(col_names[0]) && !(strlen(col_names[c]) == len && strncmp(w, col_names[c], len) == 0)) ++c;
+        if (c == sizeof(col_names) / sizeof(col_names[0])) return 0;
+        cols |= 1u << c;
+        if (!w[len]) return cols;
+        w += len + 1;
+    }
+}
+
+// columnar socket table: one array per field, addresses kept binary (network
+// byte order, IPv4 in the first 4 bytes) and only formatted when printed.
+// Owners come from the table's arena.
+typedef struct {
+    uint8_t *proto;          // proto_t
+    uint8_t *state;          // kernel TCP state (LISTEN = 0x0A; UDP reports 07 unconnected or 01)
+    uint8_t (*addr)[16];
+    uint16_t *port;
+    uint8_t (*raddr)[16];    // remote end, same encoding; zero for listeners
+    uint16_t *rport;
+    uint32_t *inode;
+    uint32_t *netns;         // --all-netns: index into g_netns, else 0
+    uint64_t *cookie;        // kernel socket cookie (netlink only, else 0)
+    uint32_t *rxq, *txq;     // -o rxq/txq: receive and send queue bytes, NULL otherwise
+    owner_info_t **owners;   // linked list of owners per row
+    size_t n, cap;
+    arena_t arena;
+    struct group_table *agg; // --group-by: table_append folds rows in here instead
+    struct stream_sink *sink;  // --stream: full batches are printed, then dropped
+} sock_table_t;
+
+// --group-by counts: open addressing on the packed key, rows = sockets folded
+typedef struct { uint8_t addr[16]; uint16_t port; uint8_t proto, state; int32_t pid; } group_key_t;
+typedef struct { group_key_t key; uint64_t count; const proc_info_t *proc; } group_slot_t;
+typedef struct group_table { group_slot_t *slots; size_t mask, n; uint64_t rows; } group_table_t;
+
+#define TABLE_GROW(col, cap) do { void *p_ = realloc((col), (cap) * sizeof(*(col))); if (!p_) return false; (col) = p_; } while (0)
+
+static bool table_reserve(sock_table_t *t, size_t want) {
+    if (want <= t->cap)
+        return true;
+    size_t cap = t->cap ? t->cap : 1024;
+    while (cap < want) cap *= 2;
+    // a failed realloc leaves earlier columns larger than cap, which is harmless
+    TABLE_GROW(t->proto, cap);
+    TABLE_GROW(t->state, cap);
+    TABLE_GROW(t->addr, cap);
+    TABLE_GROW(t->port, cap);
+    TABLE_GROW(t->raddr, cap);
+    TABLE_GROW(t->rport, cap);
+    TABLE_GROW(t->inode, cap);
+    TABLE_GROW(t->netns, cap);
+    TABLE_GROW(t->cookie, cap);
+    TABLE_GROW(t->owners, cap);
+    if (g_cols & COL_QUEUES) { TABLE_GROW(t->rxq, cap); TABLE_GROW(t->txq, cap); }
+    t->cap = cap;
+    return true;
+}
+
+static bool group_row(group_table_t *g, proto_t proto, uint8_t state, const uint8_t addr[16], uint16_t port, const uint8_t raddr[16]);
+#define STREAM_BATCH 4096u
+static void stream_flush(sock_table_t *t);
+static void stream_row_added(sock_table_t *t);
+static uint64_t stream_rows(const sock_table_t *t);
+static bool stream_full(const sock_table_t *t);
+
+static bool table_append(sock_table_t *t, proto_t proto, uint8_t state, const uint8_t addr[16], uint16_t port,
+                         const uint8_t raddr[16], uint16_t rport, uint32_t inode, uint64_t cookie, uint32_t rxq, uint32_t txq) {
+    if (t->agg)
+        return group_row(t->agg, proto, state, addr, port, raddr);
+    if (!table_reserve(t, t->n + 1))
+        return false;
+    size_t r = t->n++;
+    t->proto[r] = (uint8_t)proto;
+    t->state[r] = state;
+    memcpy(t->addr[r], addr, 16);
+    t->port[r] = port;
+    memcpy(t->raddr[r], raddr, 16);
+    t->rport[r] = rport;
+    t->inode[r] = inode;
+    t->netns[r] = 0;
+    t->cookie[r] = cookie;
+    if (t->rxq) { t->rxq[r] = rxq; t->txq[r] = txq; }
+    t->owners[r] = NULL;
+    if (t->sink) stream_row_added(t);
+    return true;
+}
+
+// row r of src, without its owners
+static bool table_copy_row(sock_table_t *t, const sock_table_t *src, size_t r) {
+    return table_append(t, src->proto[r], src->state[r], src->addr[r], src->port[r], src->raddr[r], src->rport[r], src->inode[r], src->cookie[r],
+                        src->rxq ? src->rxq[r] : 0, src->txq ? src->txq[r] : 0);
+}
+
+// every row of src, without owners, appended column by column; for tables
+// that don't fold into groups
+static bool table_concat(sock_table_t *t, const sock_table_t *src) {
+    if (!table_reserve(t, t->n + src->n)) return false;
+#define COPY_COL(col) memcpy(t->col + t->n, src->col, src->n * sizeof(*t->col))
+    COPY_COL(proto); COPY_COL(state); COPY_COL(addr); COPY_COL(port); COPY_COL(raddr);
+    COPY_COL(rport); COPY_COL(inode); COPY_COL(netns); COPY_COL(cookie);
+    if (t->rxq && src->rxq) { COPY_COL(rxq); COPY_COL(txq); }
+#undef COPY_COL
+    for (size_t r = 0; r < src->n; ++r) t->owners[t->n + r] = NULL;
+    t->n += src->n;
+    return true;
+}
+
+#define PROTO_MASK_ALL   0xfu
+#define PROTO_MASK_TCP   ((1u << PROTO_TCP) | (1u << PROTO_TCP6))
+#define PROTO_MASK_UDP   ((1u << PROTO_UDP) | (1u << PROTO_UDP6))
 
 // config
 static bool g_show_all = false;
 static int g_search_port = 0;
-static const char *g_search_name = NULL;
+static pid_t g_search_pid = 0;   // --pid: only sockets held by this process
+
+// -n patterns: a process matches if its name contains any of them, ignoring
+// ASCII case, or with --regex if it matches any of them as an extended
+// regular expression. They are compiled once into a single matcher: an
+// Aho-Corasick automaton over case-folded bytes, completed into a DFA so a
+// name costs one table lookup per byte whatever the number of patterns, or
+// one regex alternation. Every compile gets a new gen, which procs use to
+// cache their verdict (proc_info_t.name_gen).
+typedef struct {
+    const char **pats;
+    size_t npats, cap;
+    bool regex;
+    bool active;            // compiled with at least one non-empty pattern
+    unsigned gen;
+    uint8_t cls[256];       // byte -> input class, the same for both cases; 0: in no pattern
+    size_t nclasses;
+    uint32_t *next;         // per state, the next state for every class
+    uint8_t *out;           // some pattern ends in this state
+    regex_t re;
+} name_matcher_t;
+static name_matcher_t g_names = {0};
+static unsigned g_names_gen = 0;
+
+static inline unsigned char fold_ascii(unsigned char c) { return c >= 'A' && c <= 'Z' ? (unsigned char)(c + 32) : c; }
+
+static bool name_add(name_matcher_t *m, const char *pat) {
+    if (m->npats == m->cap) {
+        size_t cap = m->cap ? m->cap * 2 : 8;
+        const char **p = realloc(m->pats, cap * sizeof(*p));
+        if (!p) return false;
+        m->pats = p; m->cap = cap;
+    }
+    m->pats[m->npats++] = pat;
+    return true;
+}
+
+static void name_free(name_matcher_t *m) {
+    if (m->active && m->regex) regfree(&m->re);
+    free(m->pats); free(m->next); free(m->out);
+    memset(m, 0, sizeof(*m));
+}
+
+// false, with err filled in, for a --regex that doesn't compile or no memory.
+// Empty patterns are ignored, so -n "" filters nothing.
+static bool name_compile(name_matcher_t *m, char *err, size_t errlen) {
+    m->gen = ++g_names_gen;
+    size_t n = 0, len = 0;
+    for (size_t i = 0; i < m->npats; ++i)
+        if (*m->pats[i]) { ++n; len += strlen(m->pats[i]); }
+    if (!n) return true;
+
+    if (m->regex) {
+        char *src = malloc(len + 3 * n), *p = src;  // (a)|(b)|...
+        if (!src) { snprintf(err, errlen, "out of memory"); return false; }
+        for (size_t i = 0; i < m->npats; ++i) {
+            if (!*m->pats[i]) continue;
+            if (p != src) *p++ = '|';
+            *p++ = '(';
+            p = stpcpy(p, m->pats[i]);
+            *p++ = ')';
+        }
+        *p = 0;
+        int rc = regcomp(&m->re, src, REG_EXTENDED | REG_ICASE | REG_NOSUB);
+        free(src);
+        if (rc) { regerror(rc, &m->re, err, errlen); return false; }
+        m->active = true;
+        return true;
+    }
+
+    // one class per distinct folded byte of the patterns, class 0 for the rest
+    memset(m->cls, 0, sizeof(m->cls));
+    m->nclasses = 1;
+    for (size_t i = 0; i < m->npats; ++i)
+        for (const unsigned char *c = (const unsigned char *)m->pats[i]; *c; ++c)
+            if (!m->cls[fold_ascii(*c)]) m->cls[fold_ascii(*c)] = (uint8_t)m->nclasses++;
+    for (unsigned c = 0; c < 256; ++c) m->cls[c] = m->cls[fold_ascii((unsigned char)c)];
+
+    // the trie (state 0 is the root, so 0 also means "no edge" until completed)
+    size_t k = m->nclasses, maxst = len + 1, ns = 1;
+    m->next = calloc(maxst * k, sizeof(*m->next));
+    m->out = calloc(maxst, 1);
+    uint32_t *fail = malloc(maxst * sizeof(*fail)), *queue = malloc(maxst * sizeof(*queue));
+    if (!m->next || !m->out || !fail || !queue) {
+        free(fail); free(queue);
+        snprintf(err, errlen, "out of memory");
+        return false;
+    }
+    for (size_t i = 0; i < m->npats; ++i) {
+        if (!*m->pats[i]) continue;
+        uint32_t s = 0;
+        for (const unsigned char *c = (const unsigned char *)m->pats[i]; *c; ++c) {
+            uint32_t *e = &m->next[s * k + m->cls[*c]];
+            if (!*e) *e = (uint32_t)ns++;
+            s = *e;
+        }
+        m->out[s] = 1;
+    }
+    // breadth first, so a state's failure state (shorter) is complete before
+    // it: missing edges take the failure state's, and outputs are inherited
+    size_t qh = 0, qt = 0;
+    for (size_t c = 0; c < k; ++c)
+        if (m->next[c]) { fail[m->next[c]] = 0; queue[qt++] = m->next[c]; }
+    while (qh < qt) {
+        uint32_t s = queue[qh++];
+        m->out[s] |= m->out[fail[s]];
+        for (size_t c = 0; c < k; ++c) {
+            uint32_t t = m->next[s * k + c];
+            if (t) { fail[t] = m->next[fail[s] * k + c]; queue[qt++] = t; }
+            else m->next[s * k + c] = m->next[fail[s] * k + c];
+        }
+    }
+    free(fail); free(queue);
+    m->active = true;
+    return true;
+}
+
+static bool name_match(const name_matcher_t *m, const char *name) {
+    if (!m->active) return true;
+    if (m->regex) return regexec(&m->re, name, 0, NULL, 0) == 0;
+    uint32_t s = 0;
+    for (const unsigned char *c = (const unsigned char *)name; *c; ++c)
+        if (m->out[s = m->next[s * m->nclasses + m->cls[*c]]]) return true;
+    return false;
+}
+
+typedef enum { FORMAT_TABLE, FORMAT_JSON, FORMAT_NDJSON, FORMAT_COLUMNAR, FORMAT_COUNT } out_format_t;
+static out_format_t g_format = FORMAT_TABLE;  // -j array, --ndjson one object per line, --format
+static const char *const format_names[FORMAT_COUNT] = { "table", "json", "ndjson", "columnar" };
 
-typedef enum { SORT_PORT, SORT_PROTO } sort_field_t;
+// FORMAT_COUNT for an unknown name
+static out_format_t parse_format(const char *name) {
+    int f = 0;
+    while (f < FORMAT_COUNT && strcmp(name, format_names[f]) != 0) ++f;
+    return (out_format_t)f;
+}
+
+typedef enum { GROUP_NONE, GROUP_LOCAL, GROUP_REMOTE, GROUP_PID, GROUP_STATE } group_by_t;
+static group_by_t g_group_by = GROUP_NONE;    // --group-by: print counts per key
+
+typedef enum { SORT_PORT, SORT_PROTO, SORT_PID } sort_field_t;
 static sort_field_t g_sort_field = SORT_PORT;
 static bool g_sort_reverse = false;
+static size_t g_limit = 0;       // --limit: print only the first N rows (0: all)
+static int g_jobs = 1;           // owner-scan threads (-J)
+static bool g_first_owner = false;  // --first-owner: one owner per socket, stop once all have one
+static const char *g_proc_root = "/proc";  // PORTS_PROC_ROOT: synthetic fixtures for benchmarks
+static const char *g_cache_path = NULL;    // --cache: inode -> pid attribution kept across runs
+
+// --all-netns: the namespaces found, rows refer to them by index
+typedef struct { uint64_t ino; pid_t pid; char cgroup[256]; } netns_info_t;
+static bool g_all_netns = false;
+static netns_info_t *g_netns = NULL;
+static size_t g_nnetns = 0;
+
+static bool netns_tagged(void) { return g_all_netns && g_nnetns; }
+
+// --stats: pipeline counters are plain increments and always compiled in;
+// only the stage clocks (CLOCK_PROCESS_CPUTIME_ID is a real syscall) are
+// skipped unless stats were asked for
+typedef enum { STATS_OFF, STATS_TEXT, STATS_JSON } stats_mode_t;
+static stats_mode_t g_stats_mode = STATS_OFF;
+
+typedef struct {
+    uint64_t lines, records, sockets, pids, fds, readlinks, inode_hits, inode_misses, comm_reads, col_reads, cache_hits, eacces;
+} stats_t;
+static stats_t g_stats;
+
+typedef enum { STAGE_PARSE, STAGE_INDEX, STAGE_OWNERS, STAGE_SORT, STAGE_PRINT, STAGE_COUNT } stage_t;
+static const char *const stage_names[STAGE_COUNT] = { "parse", "index", "owners", "sort", "print" };
+typedef struct { double wall, cpu; } stamp_t;
+static stamp_t g_stage[STAGE_COUNT];
+
+static stamp_t stamp_now(void) {
+    stamp_t s = {0, 0};
+    if (g_stats_mode == STATS_OFF) return s;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts); s.wall = (double)ts.tv_sec + ts.tv_nsec / 1e9;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts); s.cpu = (double)ts.tv_sec + ts.tv_nsec / 1e9;
+    return s;
+}
+
+static void stage_done(stage_t st, stamp_t since) {
+    if (g_stats_mode == STATS_OFF) return;
+    stamp_t now = stamp_now();
+    g_stage[st].wall += now.wall - since.wall;
+    g_stage[st].cpu += now.cpu - since.cpu;
+}
+
+// the parsers may run on several threads at once (--all-netns), so they
+// count locally and add their totals with this
+static inline void stats_add(uint64_t *counter, uint64_t n) { if (n) __atomic_fetch_add(counter, n, __ATOMIC_RELAXED); }
+
+static void stats_merge(stats_t *dst, const stats_t *src) {
+    dst->pids += src->pids; dst->fds += src->fds; dst->readlinks += src->readlinks; dst->comm_reads += src->comm_reads; dst->col_reads += src->col_reads;
+    dst->inode_hits += src->inode_hits; dst->inode_misses += src->inode_misses; dst->cache_hits += src->cache_hits; dst->eacces += src->eacces;
+}
+
+static void print_stats(FILE *out) {
+    static const struct { const char *key, *label; size_t off; } counters[] = {
+        { "lines",        "/proc/net lines parsed", offsetof(stats_t, lines) },
+        { "records",      "netlink records",        offsetof(stats_t, records) },
+        { "sockets",      "sockets kept",           offsetof(stats_t, sockets) },
+        { "pids",         "pids visited",           offsetof(stats_t, pids) },
+        { "fds",          "fds listed",             offsetof(stats_t, fds) },
+        { "readlinks",    "fds readlink'ed",        offsetof(stats_t, readlinks) },
+        { "inode_hits",   "inode hits",             offsetof(stats_t, inode_hits) },
+        { "inode_misses", "inode misses",           offsetof(stats_t, inode_misses) },
+        { "comm_reads",   "comm reads",             offsetof(stats_t, comm_reads) },
+        { "col_reads",    "-o process reads",       offsetof(stats_t, col_reads) },
+        { "cache_hits",   "pids from --cache",      offsetof(stats_t, cache_hits) },
+        { "eacces",       "EACCES failures",        offsetof(stats_t, eacces) },
+    };
+    const size_t ncounters = sizeof(counters) / sizeof(counters[0]);
+    stamp_t total = {0, 0};
+    for (int s = 0; s < STAGE_COUNT; ++s) { total.wall += g_stage[s].wall; total.cpu += g_stage[s].cpu; }
+#define COUNTER(i) (*(const uint64_t *)((const char *)&g_stats + counters[i].off))
+
+    if (g_stats_mode == STATS_JSON) {
+        fprintf(out, "{\"stages\":{");
+        for (int s = 0; s < STAGE_COUNT; ++s)
+            fprintf(out, "%s\"%s\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f}", s ? "," : "", stage_names[s], g_stage[s].wall * 1e3, g_stage[s].cpu * 1e3);
+        fprintf(out, ",\"total\":{\"wall_ms\":%.3f,\"cpu_ms\":%.3f}},\"counters\":{", total.wall * 1e3, total.cpu * 1e3);
+        for (size_t i = 0; i < ncounters; ++i)
+            fprintf(out, "%s\"%s\":%" PRIu64, i ? "," : "", counters[i].key, COUNTER(i));
+        fprintf(out, "}}\n");
+    } else {
+        fprintf(out, "stage      wall ms     cpu ms\n");
+        for (int s = 0; s < STAGE_COUNT; ++s)
+            fprintf(out, "%-8s %9.3f  %9.3f\n", stage_names[s], g_stage[s].wall * 1e3, g_stage[s].cpu * 1e3);
+        fprintf(out, "%-8s %9.3f  %9.3f\n", "total", total.wall * 1e3, total.cpu * 1e3);
+        for (size_t i = 0; i < ncounters; ++i)
+            fprintf(out, "%-24s %" PRIu64 "\n", counters[i].label, COUNTER(i));
+    }
+#undef COUNTER
+}
 
 // helpers
-static unsigned hex_to_port(const char *hex) { return (unsigned)strtoul(hex, NULL, 16); }
 
-static void hex_to_ipstr(const char *hex, bool is_v6, char *out, size_t out_len) {
-    if (!hex || !*hex) { snprintf(out, out_len, "-"); return; }
+// fixed-width hex field scanned in place: n digits at p, false on a non-hex digit
+static inline bool scan_hex(const char *p, int n, uint32_t *out) {
+    uint32_t v = 0;
+    for (int i = 0; i < n; ++i) {
+        unsigned c = (unsigned char)p[i], d = c - '0';
+        if (d > 9) { d = (c | 0x20) - 'a'; if (d > 5) return false; d += 10; }
+        v = v << 4 | d;
+    }
+    *out = v;
+    return true;
+}
+
+// /proc/net prints each 32-bit address word with %08X of its in-memory value,
+// so storing the parsed word back in native order restores network order
+static bool scan_addr(const char *p, bool is_v6, uint8_t out[16]) {
+    memset(out, 0, 16);
+    for (int w = 0; w < (is_v6 ? 4 : 1); ++w) {
+        uint32_t v;
+        if (!scan_hex(p + w * 8, 8, &v)) return false;
+        memcpy(out + w * 4, &v, 4);
+    }
+    return true;
+}
+
+// SIMD hex decoding of a local "ADDR:PORT" field: one kernel turns the 8 or 32
+// address digits and the 4 port digits into binary, false on a non-hex digit.
+// The variant is picked once per process from the CPU features (AVX2, SSE4.1,
+// NEON); the scalar kernel above is the portable path and the reference.
+// PORTS_NO_SIMD=1 forces it, e.g. to compare outputs.
+typedef bool (*addr_kernel_t)(const char *p, bool is_v6, uint8_t out[16], uint32_t *port);
+
+static bool decode_addr_scalar(const char *p, bool is_v6, uint8_t out[16], uint32_t *port) {
+    return scan_addr(p, is_v6, out) && scan_hex(p + (is_v6 ? 33 : 9), 4, port);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 16 hex chars -> 16 nibbles; *bad collects lanes that were not hex digits.
+// As in scan_hex(), a lane is valid if c - '0' <= 9 or (c | 0x20) - 'a' <= 5
+// (unsigned), so neighbours like '@' and '`' are rejected too
+__attribute__((target("sse4.1"))) static inline __m128i hex_nibbles_sse(__m128i v, __m128i *bad) {
+    __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    __m128i alpha = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+    *bad = _mm_or_si128(*bad, _mm_andnot_si128(_mm_or_si128(is_digit, is_alpha), _mm_set1_epi8(-1)));
+    return _mm_blendv_epi8(_mm_add_epi8(alpha, _mm_set1_epi8(10)), digit, is_digit);
+}
+
+// pairs of nibbles -> bytes in printed order (hi * 16 + lo), packed into 8 bytes per input
+__attribute__((target("sse4.1"))) static inline __m128i hex_pack_sse(__m128i n0, __m128i n1) {
+    const __m128i w = _mm_set1_epi16(0x0110);
+    return _mm_packus_epi16(_mm_maddubs_epi16(n0, w), _mm_maddubs_epi16(n1, w));
+}
+
+__attribute__((target("sse4.1"))) static bool decode_addr_sse(const char *p, bool is_v6, uint8_t out[16], uint32_t *port) {
+    __m128i bad = _mm_setzero_si128();
     if (!is_v6) {
-        unsigned long val = strtoul(hex, NULL, 16);
-        unsigned a = val & 0xff, b = (val>>8)&0xff, c = (val>>16)&0xff, d = (val>>24)&0xff;
-        snprintf(out, out_len, "%u.%u.%u.%u", a,b,c,d);
+        // "AAAAAAAA:PPPP ..": gather the 12 digits around the colon in one load
+        const __m128i gather = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 9, 10, 11, 12, 9, 10, 11, 12);
+        __m128i nib = hex_nibbles_sse(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), gather), &bad);
+        if (!_mm_testz_si128(bad, bad)) return false;
+        uint64_t x = (uint64_t)_mm_cvtsi128_si64(hex_pack_sse(nib, nib));
+        uint32_t a = __builtin_bswap32((uint32_t)x);
+        memset(out, 0, 16);
+        memcpy(out, &a, 4);
+        *port = (uint32_t)(x >> 32 & 0xff) << 8 | (uint32_t)(x >> 40 & 0xff);
+        return true;
+    }
+    __m128i n0 = hex_nibbles_sse(_mm_loadu_si128((const __m128i *)p), &bad);
+    __m128i n1 = hex_nibbles_sse(_mm_loadu_si128((const __m128i *)(p + 16)), &bad);
+    if (!_mm_testz_si128(bad, bad)) return false;
+    // each printed word is the %08X of a native u32: reverse the bytes per word
+    const __m128i rev = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(hex_pack_sse(n0, n1), rev));
+    return scan_hex(p + 33, 4, port);
+}
+
+__attribute__((target("avx2"))) static bool decode_addr_avx2(const char *p, bool is_v6, uint8_t out[16], uint32_t *port) {
+    if (!is_v6)
+        return decode_addr_sse(p, is_v6, out, port);
+    // all 32 IPv6 digits in one register
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    __m256i alpha = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    __m256i is_alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)), alpha);
+    // testc: every lane is a digit or a letter
+    if (!_mm256_testc_si256(_mm256_or_si256(is_digit, is_alpha), _mm256_set1_epi8(-1))) return false;
+    __m256i nib = _mm256_blendv_epi8(_mm256_add_epi8(alpha, _mm256_set1_epi8(10)), digit, is_digit);
+    __m256i b = _mm256_maddubs_epi16(nib, _mm256_set1_epi16(0x0110));
+    b = _mm256_permute4x64_epi64(_mm256_packus_epi16(b, b), _MM_SHUFFLE(3, 1, 2, 0));
+    const __m128i rev = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(_mm256_castsi256_si128(b), rev));
+    return scan_hex(p + 33, 4, port);
+}
+#elif defined(__aarch64__)
+static inline uint8x16_t hex_nibbles_neon(uint8x16_t v, uint8x16_t *bad) {
+    uint8x16_t digit = vsubq_u8(v, vdupq_n_u8('0'));
+    uint8x16_t alpha = vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t is_digit = vcleq_u8(digit, vdupq_n_u8(9));
+    *bad = vorrq_u8(*bad, vmvnq_u8(vorrq_u8(is_digit, vcleq_u8(alpha, vdupq_n_u8(5)))));  // as hex_nibbles_sse()
+    return vbslq_u8(is_digit, digit, vaddq_u8(alpha, vdupq_n_u8(10)));
+}
+
+static bool decode_addr_neon(const char *p, bool is_v6, uint8_t out[16], uint32_t *port) {
+    uint8x16_t bad = vdupq_n_u8(0);
+    if (!is_v6) {
+        static const uint8_t gather[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 9, 10, 11, 12, 9, 10, 11, 12 };
+        uint8x16_t nib = hex_nibbles_neon(vqtbl1q_u8(vld1q_u8((const uint8_t *)p), vld1q_u8(gather)), &bad);
+        if (vmaxvq_u8(bad)) return false;
+        uint8x16_t bytes = vorrq_u8(vshlq_n_u8(vuzp1q_u8(nib, nib), 4), vuzp2q_u8(nib, nib));
+        uint64_t x = vgetq_lane_u64(vreinterpretq_u64_u8(bytes), 0);
+        uint32_t a = __builtin_bswap32((uint32_t)x);
+        memset(out, 0, 16);
+        memcpy(out, &a, 4);
+        *port = (uint32_t)(x >> 32 & 0xff) << 8 | (uint32_t)(x >> 40 & 0xff);
+        return true;
+    }
+    uint8x16_t n0 = hex_nibbles_neon(vld1q_u8((const uint8_t *)p), &bad);
+    uint8x16_t n1 = hex_nibbles_neon(vld1q_u8((const uint8_t *)p + 16), &bad);
+    if (vmaxvq_u8(bad)) return false;
+    uint8x16_t bytes = vorrq_u8(vshlq_n_u8(vuzp1q_u8(n0, n1), 4), vuzp2q_u8(n0, n1));
+    vst1q_u8(out, vrev32q_u8(bytes));
+    return scan_hex(p + 33, 4, port);
+}
+#endif
+
+static addr_kernel_t g_decode_addr = decode_addr_scalar;
+static pthread_once_t g_decode_once = PTHREAD_ONCE_INIT;
+
+static void select_addr_kernel(void) {
+    const char *off = getenv("PORTS_NO_SIMD");
+    if (off && *off && strcmp(off, "0") != 0)
         return;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) g_decode_addr = decode_addr_avx2;
+    else if (__builtin_cpu_supports("sse4.1")) g_decode_addr = decode_addr_sse;
+#elif defined(__aarch64__)
+    g_decode_addr = decode_addr_neon;  // NEON is baseline on AArch64
+#endif
+}
+
+static char *format_ipv4(const uint8_t a[4], char *o) {
+    for (int i = 0; i < 4; ++i) {
+        unsigned v = a[i];
+        if (v >= 100) *o++ = (char)('0' + v / 100);
+        if (v >= 10) *o++ = (char)('0' + v / 10 % 10);
+        *o++ = (char)('0' + v % 10);
+        if (i < 3) *o++ = '.';
+    }
+    return o;
+}
+
+// same text as inet_ntop(): lowercase hex, the first longest run of two or
+// more zero groups shortened to "::", and IPv4-mapped (::ffff:a.b.c.d) or
+// IPv4-compatible (::a.b.c.d) addresses ending in dotted quad. Writes at
+// most INET6_ADDRSTRLEN bytes including the NUL; returns the length.
+static size_t format_addr(const uint8_t addr[16], bool is_v6, char *out) {
+    char *o = out;
+    if (!is_v6) { o = format_ipv4(addr, o); *o = 0; return (size_t)(o - out); }
+    static const char hex[] = "0123456789abcdef";
+    unsigned w[8];
+    int best = -1, best_len = 0;
+    for (int i = 0, run = 0; i < 8; ++i) {
+        w[i] = (unsigned)addr[2 * i] << 8 | addr[2 * i + 1];
+        run = w[i] ? 0 : run + 1;
+        if (run > best_len) { best_len = run; best = i - run + 1; }
     }
-    // simple IPv6 parse: hex string 32 bytes -> bytes
-    unsigned char buf[16]={0};
-    size_t len = strlen(hex);
-    char tmp[33];
-    if (len < 32) {
-        memset(tmp, '0', 32); tmp[32]=0; memcpy(tmp + (32 - len), hex, len); hex = tmp; len=32;
+    if (best_len < 2) best = -1;
+    for (int i = 0; i < 8; ++i) {
+        if (i == best) { *o++ = ':'; if (i + best_len == 8) *o++ = ':'; i += best_len - 1; continue; }
+        if (i) *o++ = ':';
+        if (i == 6 && best == 0 && (best_len == 6 || (best_len == 5 && w[5] == 0xffff))) { o = format_ipv4(addr + 12, o); break; }
+        bool lead = true;
+        for (int sh = 12; sh >= 0; sh -= 4) {
+            unsigned d = w[i] >> sh & 0xf;
+            if (d || !lead || sh == 0) { *o++ = hex[d]; lead = false; }
+        }
     }
-    for (int i=0;i<16;i++) { unsigned int b=0; sscanf(&hex[i*2], "%2x", &b); buf[i]=b; }
-    struct in6_addr a6; memcpy(&a6.s6_addr, buf, 16);
-    if (!inet_ntop(AF_INET6, &a6, out, out_len)) snprintf(out, out_len, "::");
+    *o = 0;
+    return (size_t)(o - out);
 }
 
-static void add_owner(sock_entry_t *e, pid_t pid, const char *name)
+static void add_owner(sock_table_t *t, size_t row, proc_info_t *proc)
 {
-    owner_info_t *n = malloc(sizeof(*n));
+    owner_info_t *n = arena_alloc(&t->arena, sizeof(*n));
     if (!n)
         return;
 
-    n->pid = pid;
-    strncpy(n->name, name ? name : "", sizeof(n->name) - 1);
-    n->name[sizeof(n->name) - 1] = '\0';
-    n->next = e->owners;
-    e->owners = n;
+    n->proc = proc;
+    n->next = t->owners[row];
+    t->owners[row] = n;
 }
 
-static void free_entries(sock_entry_t *head) {
-    while (head) { sock_entry_t *n = head->next; owner_info_t *o=head->owners; while(o){owner_info_t *no=o->next; free(o); o=no;} free(head); head=n; }
+// one owner record with the -o strings it holds
+static void proc_info_free(proc_info_t *p) {
+    if (!p) return;
+    free(p->cmdline); free(p->cgroup);
+    free(p);
 }
 
-// parse /proc/net/* and build initial entries
-static void parse_proc_net(sock_entry_t **head, const char *path, const char *proto, bool only_listen) {
-    FILE *f = fopen(path, "r"); if (!f) return; char line[1024]; if (!fgets(line, sizeof(line), f)) { fclose(f); return; }
-    while (fgets(line, sizeof(line), f)) {
-        // tokens
-        char local[128]={0}, rem[128]={0}, st[16]={0}; unsigned long inode=0; 
-        char *tokens[32];
-        int tokc = 0;
-        char *p = line, *save = NULL;
+static void free_procs(proc_info_t *head) {
+    while (head) { proc_info_t *n = head->next; proc_info_free(head); head = n; }
+}
+
+static void free_entries(sock_table_t *t) {
+    free(t->proto); free(t->state); free(t->addr); free(t->port); free(t->raddr); free(t->rport); free(t->inode); free(t->netns); free(t->cookie); free(t->owners);
+    free(t->rxq); free(t->txq);
+    arena_free(&t->arena);
+    memset(t, 0, sizeof(*t));
+}
+
+// one /proc/net data line, [p, end) without the newline:
+//   "  sl: LOCAL:PORT REMOTE:PORT ST TX:RX TR:WHEN RETRNSMT UID TIMEOUT INODE ..."
+// Everything up to the state has a fixed width per family (8 or 32 address
+// digits), so the state is checked at a known offset before the address and
+// port are decoded. proto is a constant in every caller (see net_parsers), so
+// the offsets and the listen state fold into each specialized loop.
+static inline __attribute__((always_inline))
+void parse_net_line(sock_table_t *t, const char *p, const char *end, proto_t proto, bool only_listen, int want_port) {
+    const bool v6 = proto_is_v6(proto);
+    const ptrdiff_t alen = v6 ? 32 : 8, fixed = 2 * (alen + 6) + 2;  // "LOCAL:PORT REMOTE:PORT ST"
+
+    while (p < end && *p == ' ') ++p;
+    while (p < end && *p != ':') ++p;  // slot number
+    if (end - p < fixed + 2) return;
+    p += 2;
+    if ((p[-1] != ' ') | (p[alen] != ':') | (p[alen + 5] != ' ') | (p[2 * alen + 11] != ' ')) return;
+
+    uint32_t st, port, rport;
+    if (!scan_hex(p + 2 * (alen + 6), 2, &st)) return;
+    if (only_listen && st != listen_state(proto))
+        return; // 0A for TCP, 07 for UDP
+    uint8_t addr[16], raddr[16];
+    if (!g_decode_addr(p, v6, addr, &port)) return;
+    if (want_port > 0 && port != (uint32_t)want_port)
+        return; // -p: drop before the row is materialized
+    if (!g_decode_addr(p + alen + 6, v6, raddr, &rport)) return;
+
+    // the inode is the 6th field after the state. The kernel prints the first
+    // three with fixed widths (" %08X:%08X %02X:%08lX %08X"), so those are
+    // stepped over at once when the separators line up; uid and timeout are
+    // padded but unbounded and are walked
+    const char *q = p + fixed;
+    uint32_t txq = 0, rxq = 0;  // " %08X:%08X", only decoded for -o
+    if ((g_cols & COL_QUEUES) && end - q > 18 && q[9] == ':') { scan_hex(q + 1, 8, &txq); scan_hex(q + 10, 8, &rxq); }
+    int f = 0;
+    if (end - q > 40 && (q[9] == ':') & (q[18] == ' ') & (q[21] == ':') & (q[30] == ' ') & (q[39] == ' ')) { q += 39; f = 3; }
+    for (; f < 6; ++f) {
+        while (q < end && *q == ' ') ++q;
+        if (f < 5) while (q < end && *q != ' ') ++q;
+    }
+    unsigned long inode = 0;
+    while (q < end && *q >= '0' && *q <= '9') inode = inode * 10 + (unsigned)(*q++ - '0');
+    table_append(t, proto, (uint8_t)st, addr, (uint16_t)port, raddr, (uint16_t)rport, (uint32_t)inode, 0, rxq, txq);
+}
+
+// the lines of [p, end) up to the last newline; returns where the partial
+// line left for the next read starts
+static inline __attribute__((always_inline))
+const char *parse_net_lines(sock_table_t *t, const char *p, const char *end, proto_t proto, bool only_listen, int want_port, uint64_t *lines) {
+    const char *nl;
+    while ((nl = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        parse_net_line(t, p, nl, proto, only_listen, want_port);
+        ++*lines;
+        p = nl + 1;
+    }
+    return p;
+}
+
+// one specialization per table, picked by the proto of the file
+typedef const char *(*net_parser_t)(sock_table_t *, const char *, const char *, bool, int, uint64_t *);
+#define NET_PARSER(name, proto) \
+    static const char *name(sock_table_t *t, const char *p, const char *end, bool only_listen, int want_port, uint64_t *lines) \
+    { return parse_net_lines(t, p, end, proto, only_listen, want_port, lines); }
+NET_PARSER(parse_tcp_lines, PROTO_TCP)
+NET_PARSER(parse_tcp6_lines, PROTO_TCP6)
+NET_PARSER(parse_udp_lines, PROTO_UDP)
+NET_PARSER(parse_udp6_lines, PROTO_UDP6)
+#undef NET_PARSER
+static const net_parser_t net_parsers[] = {
+    [PROTO_TCP] = parse_tcp_lines, [PROTO_TCP6] = parse_tcp6_lines,
+    [PROTO_UDP] = parse_udp_lines, [PROTO_UDP6] = parse_udp6_lines,
+};
+
+// parse /proc/net/* and build initial entries. The file is pulled in large
+// read()s (seq_file fills each one with as many whole lines as fit) and the
+// lines are parsed in place; a partial line is carried to the next read.
+#define PROC_NET_CHUNK (256u << 10)
 
-        while ((tokc < 32) && (tokens[tokc] = strtok_r(p, " \t\n", &save))) {
-            p = NULL;
-            tokc++;
+static void parse_proc_net(sock_table_t *t, const char *path, proto_t proto, bool only_listen, int want_port) {
+    pthread_once(&g_decode_once, select_addr_kernel);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { if (errno == EACCES) stats_add(&g_stats.eacces, 1); return; }
+    size_t cap = PROC_NET_CHUNK, have = 0;
+    uint64_t lines = 0;
+    const net_parser_t parse = net_parsers[proto];
+    char *buf = malloc(cap);
+    if (!buf) { close(fd); return; }
+
+    bool header = true, eof = false;
+    while (!eof) {
+        if (have == cap) {
+            // a line longer than the buffer: grow rather than split it
+            char *nb = realloc(buf, cap * 2);
+            if (!nb) break;
+            buf = nb; cap *= 2;
         }
+        ssize_t r = read(fd, buf + have, cap - have);
+        if (r < 0) { if (errno == EINTR) continue; break; }
+        if (r == 0) { eof = true; if (!have) break; buf[have++] = '\n'; }  // unterminated last line
+        else have += (size_t)r;
 
-        if (tokc < 4)
-            continue;
+        const char *p = buf, *end = buf + have;
+        if (header) {
+            const char *nl = memchr(p, '\n', have);
+            if (!nl) continue;
+            p = nl + 1;
+            header = false;
+        }
+        p = parse(t, p, end, only_listen, want_port, &lines);
+        have = (size_t)(end - p);
+        memmove(buf, p, have);
+        if (stream_full(t)) break;
+    }
+    stats_add(&g_stats.lines, lines);
+    free(buf);
+    close(fd);
+}
 
-        strncpy(local, tokens[1], sizeof(local) - 1);
-        strncpy(rem, tokens[2], sizeof(rem) - 1);
-        strncpy(st, tokens[3], sizeof(st) - 1);
+// netlink sock_diag backend: ask the kernel for binary inet_diag_msg records
+// instead of formatting and re-parsing /proc/net text. Returns false when the
+// backend is unavailable (no NETLINK_SOCK_DIAG, proto module missing, ...) so
+// the caller can fall back to parse_proc_net().
+// states is a mask of 1 << kernel TCP state
+static bool nl_send_diag_req(int fd, int family, int protocol, unsigned states, int sport, int dport) {
+    struct {
+        struct nlmsghdr nlh;
+        struct inet_diag_req_v2 req;
+        struct nlattr bc_hdr;
+        struct inet_diag_bc_op bc[8];
+    } msg;
+    memset(&msg, 0, sizeof(msg));
 
-        if (tokc > 9 && tokens[9])
-            inode = strtoul(tokens[9], NULL, 10);
+    msg.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(msg.req));
+    msg.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    msg.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    msg.req.sdiag_family = family;
+    msg.req.sdiag_protocol = protocol;
+    msg.req.idiag_states = states;
 
-        if (only_listen && strcmp(st, "0A") != 0)
-            continue; // LISTEN is 0A
-        char *colon = strchr(local, ':'); if (!colon) continue; *colon=0; const char *porthex = colon+1; unsigned port = hex_to_port(porthex);
-        sock_entry_t *e = malloc(sizeof(*e)); if (!e) continue; memset(e,0,sizeof(*e)); strncpy(e->proto, proto, sizeof(e->proto)-1); strncpy(e->local_hex, local, sizeof(e->local_hex)-1);
-        bool v6 = (strstr(proto, "6")!=NULL); hex_to_ipstr(e->local_hex, v6, e->local_ip, sizeof(e->local_ip)); e->port=port; e->inode=inode; e->owners=NULL; e->next = *head; *head = e;
+    // port >= p && port <= p for each requested side; a failed test jumps
+    // past the end of the program, which rejects the socket
+    const struct { int port; unsigned char ge, le; } conds[] = {
+        { sport, INET_DIAG_BC_S_GE, INET_DIAG_BC_S_LE },
+        { dport, INET_DIAG_BC_D_GE, INET_DIAG_BC_D_LE },
+    };
+    int nops = 0;
+    for (size_t c = 0; c < 2; ++c)
+        if (conds[c].port > 0) nops += 4;
+    int len = nops * (int)sizeof(struct inet_diag_bc_op), at = 0;
+    for (size_t c = 0; c < 2; ++c) {
+        if (conds[c].port <= 0) continue;
+        unsigned short p = (unsigned short)conds[c].port;
+        msg.bc[at + 0] = (struct inet_diag_bc_op){ conds[c].ge, 8, (unsigned short)(len - at * 4 + 4) };
+        msg.bc[at + 1] = (struct inet_diag_bc_op){ 0, 0, p };
+        msg.bc[at + 2] = (struct inet_diag_bc_op){ conds[c].le, 8, (unsigned short)(len - (at + 2) * 4 + 4) };
+        msg.bc[at + 3] = (struct inet_diag_bc_op){ 0, 0, p };
+        at += 4;
     }
-    fclose(f);
+    if (nops) {
+        msg.bc_hdr.nla_type = INET_DIAG_REQ_BYTECODE;
+        msg.bc_hdr.nla_len = NLA_HDRLEN + len;
+        msg.nlh.nlmsg_len += NLA_ALIGN(msg.bc_hdr.nla_len);
+    }
+
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    return sendto(fd, &msg, msg.nlh.nlmsg_len, 0, (struct sockaddr *)&sa, sizeof(sa)) == (ssize_t)msg.nlh.nlmsg_len;
 }
 
-// populate owners by scanning /proc/<pid>/fd for socket:[inode]
-static void populate_owners(sock_entry_t *head) {
-    DIR *proc = opendir("/proc"); if (!proc) return; struct dirent *d;
-    while ((d = readdir(proc)) != NULL) {
-        // numeric dirs
-        char *endptr; long pid = strtol(d->d_name, &endptr, 10); if (*endptr) continue;
-        char fdpath[512]; snprintf(fdpath, sizeof(fdpath), "/proc/%ld/fd", pid);
-        DIR *fd = opendir(fdpath); if (!fd) continue; struct dirent *fdent; 
-        while ((fdent = readdir(fd)) != NULL) {
-            if (strcmp(fdent->d_name, ".") == 0 || strcmp(fdent->d_name, "..") == 0) continue;
-            char linkpath[1024], target[1024]; snprintf(linkpath, sizeof(linkpath), "%s/%s", fdpath, fdent->d_name);
-            ssize_t r = readlink(linkpath, target, sizeof(target)-1); if (r <= 0) continue; target[r]=0;
-            unsigned long inode = 0; if (sscanf(target, "socket:[%lu]", &inode) == 1) {
-                // find matching entry
-                for (sock_entry_t *e = head; e; e = e->next) {
-                    if (!e->inode || e->inode != inode)
-                        continue;
-
-                    // read comm or cmdline
-                    char comm[256] = "?";
-                    char tmp[256];
-
-                    snprintf(tmp, sizeof(tmp), "/proc/%ld/comm", pid);
-                    FILE *c = fopen(tmp, "r");
-                    if (c) {
-                        if (fgets(comm, sizeof(comm), c)) {
-                            size_t L = strlen(comm);
-                            if (L && comm[L - 1] == '\n')
-                                comm[L - 1] = 0;
-                        }
-                        fclose(c);
-                    } else {
-                        tmp[0] = 0;
-                        snprintf(tmp, sizeof(tmp), "/proc/%ld/cmdline", pid);
-                        FILE *cl = fopen(tmp, "r");
-                        if (cl) {
-                            if (fgets(comm, sizeof(comm), cl)) {
-                                for (size_t i = 0; i < strlen(comm); ++i)
-                                    if (comm[i] == 0)
-                                        comm[i] = ' ';
-                            }
-                            fclose(cl);
-                        }
-                    }
+static inline uint64_t diag_cookie(const struct inet_diag_msg *m) {
+    return (uint64_t)m->id.idiag_cookie[0] | (uint64_t)m->id.idiag_cookie[1] << 32;
+}
 
-                    add_owner(e, (pid_t)pid, comm);
-                }
+static bool parse_sock_diag(sock_table_t *t, int family, int protocol, proto_t proto, bool only_listen, int port, int dport) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (fd < 0)
+        return false;
+
+    if (!nl_send_diag_req(fd, family, protocol, only_listen ? 1u << listen_state(proto) : ~0u, port, dport)) { close(fd); return false; }
+
+    // large receive buffer: the kernel packs as many records per recv as fit
+    size_t buflen = 1 << 16;
+    char *buf = malloc(buflen);
+    if (!buf) { close(fd); return false; }
+
+    size_t first = t->n;
+    uint64_t gone = t->agg ? t->agg->rows : stream_rows(t), records = 0;
+    bool ok = false, done = false;
+    while (!done) {
+        ssize_t r = recv(fd, buf, buflen, 0);
+        if (r < 0) { if (errno == EINTR) continue; break; }
+        if (r == 0) break;
+
+        for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, (size_t)r); h = NLMSG_NEXT(h, r)) {
+            if (h->nlmsg_type == NLMSG_DONE) { ok = done = true; break; }
+            if (h->nlmsg_type == NLMSG_ERROR) { done = true; break; }
+            if (h->nlmsg_type != SOCK_DIAG_BY_FAMILY || h->nlmsg_len < NLMSG_LENGTH(sizeof(struct inet_diag_msg))) continue;
+
+            const struct inet_diag_msg *m = NLMSG_DATA(h);
+            ++records;
+            uint8_t addr[16] = {0}, raddr[16] = {0};
+            memcpy(addr, m->id.idiag_src, family == AF_INET6 ? 16 : 4);
+            memcpy(raddr, m->id.idiag_dst, family == AF_INET6 ? 16 : 4);
+            table_append(t, proto, m->idiag_state, addr, ntohs(m->id.idiag_sport), raddr, ntohs(m->id.idiag_dport), m->idiag_inode, diag_cookie(m),
+                         // /proc/net shows 0 sent for listeners, diag their backlog limit
+                         m->idiag_rqueue, m->idiag_state == TCP_LISTEN_STATE && !proto_is_udp(proto) ? 0 : m->idiag_wqueue);
+        }
+        if (stream_full(t)) ok = done = true;  // the rest of the dump is dropped with the socket
+    }
+    stats_add(&g_stats.records, records);
+    free(buf);
+    close(fd);
+
+    // only publish a complete dump; a partial one would leave the fallback with duplicates.
+    // Rows already folded into groups or streamed out can't be taken back, so those keep the partial dump.
+    if (!ok && (t->agg ? t->agg->rows : stream_rows(t)) != gone) return true;
+    if (!ok) { t->n = first; return false; }
+    return true;
+}
+
+// inode -> entry index: open addressing with linear probing. Colliding or
+// duplicate inodes simply occupy the next free slot, so a lookup walks the
+// probe run until an empty slot and visits every entry with that inode.
+typedef struct { uint32_t inode; uint32_t row; } inode_slot_t;
+typedef struct { inode_slot_t *slots; size_t mask, n; } inode_index_t;
+
+static inline size_t inode_hash(unsigned long inode) {
+    return (size_t)(((uint64_t)inode * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+// rows == NULL indexes the whole table, otherwise only the n listed rows
+static bool build_inode_index(inode_index_t *idx, const sock_table_t *t, const uint32_t *rows, size_t nrows) {
+    if (!rows) nrows = t->n;
+    size_t n = 0; for (size_t k = 0; k < nrows; ++k) if (t->inode[rows ? rows[k] : k]) ++n;
+    size_t cap = 16; while (cap < 2 * n) cap <<= 1;  // load factor <= 0.5
+
+    idx->slots = calloc(cap, sizeof(*idx->slots));
+    if (!idx->slots) { idx->mask = idx->n = 0; return false; }
+    idx->mask = cap - 1;
+    idx->n = n;
+
+    for (size_t k = 0; k < nrows; ++k) {
+        size_t r = rows ? rows[k] : k;
+        if (!t->inode[r])
+            continue; // inode 0 (TIME_WAIT, request sockets) never has an owner
+        size_t i = inode_hash(t->inode[r]) & idx->mask;
+        while (idx->slots[i].inode) i = (i + 1) & idx->mask;
+        idx->slots[i].inode = t->inode[r];
+        idx->slots[i].row = (uint32_t)r;
+    }
+    return true;
+}
+
+static void free_inode_index(inode_index_t *idx) { free(idx->slots); idx->slots = NULL; idx->mask = idx->n = 0; }
+
+// first row holding (proto, inode), or -1
+static long inode_index_find(const inode_index_t *idx, const sock_table_t *t, proto_t proto, uint32_t inode) {
+    if (!idx->slots || !inode) return -1;
+    for (size_t i = inode_hash(inode) & idx->mask; idx->slots[i].inode; i = (i + 1) & idx->mask)
+        if (idx->slots[i].inode == inode && t->proto[idx->slots[i].row] == proto)
+            return idx->slots[i].row;
+    return -1;
+}
+
+// read comm, falling back to cmdline
+static void read_proc_name(pid_t pid, char *comm, size_t len) {
+    snprintf(comm, len, "?");
+    char tmp[512];
+
+    snprintf(tmp, sizeof(tmp), "%s/%d/comm", g_proc_root, (int)pid);
+    FILE *c = fopen(tmp, "r");
+    if (c) {
+        if (fgets(comm, len, c)) {
+            size_t L = strlen(comm);
+            if (L && comm[L - 1] == '\n')
+                comm[L - 1] = 0;
+        }
+        fclose(c);
+    } else {
+        tmp[0] = 0;
+        snprintf(tmp, sizeof(tmp), "%s/%d/cmdline", g_proc_root, (int)pid);
+        FILE *cl = fopen(tmp, "r");
+        if (cl) {
+            if (fgets(comm, len, cl)) {
+                for (size_t i = 0; i < strlen(comm); ++i)
+                    if (comm[i] == 0)
+                        comm[i] = ' ';
             }
+            fclose(cl);
         }
-        closedir(fd);
     }
-    closedir(proc);
 }
 
-// comparator
-static int cmp_entries(const void *a, const void *b) {
-    const sock_entry_t *ea = *(const sock_entry_t **)a; const sock_entry_t *eb = *(const sock_entry_t **)b; int r=0;
-    switch (g_sort_field) {
-    case SORT_PORT: if (ea->port < eb->port) r=-1; else if (ea->port>eb->port) r=1; else r = strcmp(ea->proto, eb->proto); break;
-    case SORT_PROTO: r = strcmp(ea->proto, eb->proto); if (!r) r = (ea->port < eb->port)?-1:(ea->port>eb->port)?1:0; break;
+// the cgroup v2 path ("0::/kubepods/..."), else the first hierarchy listed
+static void read_cgroup(pid_t pid, char *out, size_t len) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%d/cgroup", g_proc_root, (int)pid);
+    snprintf(out, len, "-");
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    char line[1024];
+    bool have = false;
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = 0;
+        char *c = strchr(line, ':');
+        if (c) c = strchr(c + 1, ':');
+        if (!c) continue;
+        bool v2 = strncmp(line, "0::", 3) == 0;
+        if (v2 || !have) { snprintf(out, len, "%s", c + 1); have = true; }
+        if (v2) break;
     }
-    if (g_sort_reverse)
-        r = -r;
+    fclose(f);
+}
 
-    return r;
+// the whole of a small /proc file, NUL terminated; the length read or -1
+static ssize_t read_proc_file(pid_t pid, const char *file, char *buf, size_t len) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%d/%s", g_proc_root, (int)pid, file);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    size_t n = 0;
+    ssize_t r;
+    while (n < len - 1 && ((r = read(fd, buf + n, len - 1 - n)) > 0 || (r < 0 && errno == EINTR)))
+        if (r > 0) n += (size_t)r;
+    close(fd);
+    buf[n] = 0;
+    return (ssize_t)n;
 }
 
-static void print_table(sock_entry_t **arr, size_t n) {
-    printf("Proto  Port   Local IP        Inode       Owner(s)\n");
-    printf("-----  -----  --------------- ----------  ----------------------------\n");
-    for (size_t i=0;i<n;++i) {
-        sock_entry_t *e = arr[i]; if (g_search_port>0 && e->port != (unsigned)g_search_port) continue; if (g_search_name && *g_search_name) { bool match=false; for (owner_info_t *o=e->owners;o;o=o->next) if (strcasestr(o->name, g_search_name)) { match=true; break; } if (!match) continue; }
-        printf("%-5s  %-5u  %-15s  %-10lu  ", e->proto, e->port, e->local_ip, e->inode);
-        if (!e->owners) { printf("(no owner found)\n"); continue; }
-        bool first=true; for (owner_info_t *o=e->owners;o;o=o->next) { if (!first) printf(", "); first=false; printf("%d/%s", o->pid, o->name); } printf("\n");
+// the -o process columns, read once per owner record and only the ones
+// asked for: the effective uid from status, the cgroup, and the command line
+// with its NULs turned into spaces
+static void read_proc_cols(proc_info_t *p, stats_t *st) {
+    p->uid = (uid_t)-1;
+    p->cmdline = p->cgroup = NULL;
+    if (!(g_cols & COL_PROC)) return;
+    char buf[4096];
+    if (g_cols & COL_UID) {
+        st->col_reads++;
+        char *u = read_proc_file(p->pid, "status", buf, sizeof(buf)) > 0 ? strstr(buf, "\nUid:") : NULL;
+        unsigned long real, eff;
+        if (u && sscanf(u + 5, "%lu %lu", &real, &eff) == 2) p->uid = (uid_t)eff;
+    }
+    if (g_cols & COL_CGROUP) {
+        st->col_reads++;
+        read_cgroup(p->pid, buf, sizeof(buf));
+        if (strcmp(buf, "-") != 0) p->cgroup = strdup(buf);  // "-": unreadable
+    }
+    if (g_cols & COL_CMDLINE) {
+        st->col_reads++;
+        ssize_t n = read_proc_file(p->pid, "cmdline", buf, sizeof(buf));
+        while (n > 0 && buf[n - 1] == 0) --n;  // the last argument's terminator
+        for (ssize_t i = 0; i < n; ++i) if (buf[i] == 0) buf[i] = ' ';
+        if (n >= 0) { buf[n] = 0; p->cmdline = strdup(buf); }
     }
 }
 
-static void print_entries(sock_entry_t *head) {
-    size_t n=0; for (sock_entry_t *e=head; e; e=e->next) ++n;
-    if (n == 0) return;
-    sock_entry_t **arr = malloc(n*sizeof(*arr)); if (!arr) return; size_t i=0; for (sock_entry_t *e=head; e; e=e->next) arr[i++]=e; qsort(arr, n, sizeof(*arr), cmp_entries);
-    print_table(arr, n);
-    free(arr);
+// per-pid result of an fd scan: the shared owner record plus the matched
+// entries in discovery order. Workers only ever write their own slot, and the
+// merge in populate_owners() replays them in /proc order, so the owner lists
+// come out identical no matter how the pids were spread across threads.
+// Without an index (owner_prescan_t) match holds every socket inode instead,
+// and with --cache the pid's identity and cache record ride along.
+struct cache_proc;
+typedef struct {
+    proc_info_t *proc; uint32_t *match; size_t n, cap; stats_t st;
+    uint64_t start, nfds;             // --cache: identity seen by this run, 0 if unknown
+    const struct cache_proc *cached;  // --cache: still valid record of the last run
+    bool walked;                      // every socket fd of the pid is in match
+} pid_scan_t;
+
+// append one match to a pid's scan result
+static void pid_scan_push(pid_scan_t *r, uint32_t row) {
+    if (r->n == r->cap) {
+        size_t cap = r->cap ? r->cap * 2 : 4;
+        uint32_t *m = realloc(r->match, cap * sizeof(*m));
+        if (!m) return;
+        r->match = m; r->cap = cap;
+    }
+    r->match[r->n++] = row;
 }
 
-static void usage(const char *p) { fprintf(stderr, "usage: %s [-a] [-p port] [-n name] [-s port|pid|proto] [-r] [-j]\n", p); }
+// the scanned pid's owner record, made at its first match; name is its comm
+// when -n already read it
+static bool pid_scan_proc(pid_scan_t *out, pid_t pid, const char *name) {
+    if (out->proc) return true;
+    if (!(out->proc = malloc(sizeof(*out->proc)))) return false;
+    out->proc->pid = pid;
+    out->proc->gen = 0;
+    out->proc->name_gen = 0;
+    if (name) memcpy(out->proc->name, name, sizeof(out->proc->name));
+    else { read_proc_name(pid, out->proc->name, sizeof(out->proc->name)); out->st.comm_reads++; }
+    read_proc_cols(out->proc, &out->st);
+    out->proc->next = NULL;
+    return true;
+}
 
-int main(int argc, char **argv) {
-    int opt; while ((opt = getopt(argc, argv, "ap:n:s:r")) != -1) {
-        switch (opt) {
-        case 'a': g_show_all = true; break;
-        case 'p': g_search_port = atoi(optarg); break;
-        case 'n': g_search_name = optarg; break;
-        case 's': if (strcmp(optarg, "port") == 0) g_sort_field = SORT_PORT; else if (strcmp(optarg, "proto") == 0) g_sort_field = SORT_PROTO; else { fprintf(stderr, "unknown sort: %s\n", optarg); usage(argv[0]); return 2; } break;
-        case 'r': g_sort_reverse = true; break;
-        default: usage(argv[0]); return 2; }
+// --first-owner: each index slot is claimed by the first process found
+// holding it, and the scan ends as soon as no requested row is left. One
+// goal is shared by all scan threads; a NULL goal means a complete scan.
+typedef struct { atomic_size_t remaining; atomic_uchar *claimed; } owner_goal_t;
+
+static inline bool goal_met(owner_goal_t *g) {
+    return g && atomic_load_explicit(&g->remaining, memory_order_relaxed) == 0;
+}
+
+static inline bool goal_claim(owner_goal_t *g, size_t slot) {
+    if (!g) return true;
+    if (atomic_exchange_explicit(&g->claimed[slot], 1, memory_order_relaxed)) return false;
+    atomic_fetch_sub_explicit(&g->remaining, 1, memory_order_relaxed);
+    return true;
+}
+
+// /proc is walked with raw getdents64 in large batches instead of readdir's
+// 32 KiB ones: processes with a million fds need far fewer calls
+struct linux_dirent64 { uint64_t d_ino; int64_t d_off; unsigned short d_reclen; unsigned char d_type; char d_name[]; };
+#define DENTS_BUF (256u << 10)
+
+static long sys_getdents64(int fd, void *buf, size_t len) { return syscall(SYS_getdents64, fd, buf, len); }
+
+// --cache: the socket inodes every process held at the last run, so that
+// processes which look unchanged are not walked again. A process is
+// identified by its pid and start time (field 22 of /proc/<pid>/stat) and is
+// taken as unchanged while its fd count, the size the kernel reports for
+// /proc/<pid>/fd (Linux 6.2+), stays the same; where that size is 0 the pid
+// is always walked. A process that closed a socket and opened another keeps
+// its old record until its fd count moves. The file is mapped read-only at
+// startup and replaced (temporary file, then rename) by the walk's result;
+// files not owned by the caller are ignored.
+//
+// Layout, host byte order:
+//   cache_header_t
+//   cache_proc_t[nprocs]       sorted by pid
+//   uint32_t inodes[ninodes]   record p holds inodes[first .. first + count)
+#define CACHE_MAGIC "PORTSCCH"
+#define CACHE_VERSION 1u
+
+typedef struct { char magic[8]; uint32_t version, nprocs; uint64_t ninodes; } cache_header_t;
+typedef struct cache_proc { int32_t pid; uint32_t count; uint64_t start, nfds, first; char name[64]; } cache_proc_t;  // name "" if unknown
+
+static struct { char *map; size_t size; const cache_proc_t *procs; const uint32_t *inodes; uint32_t nprocs; uint64_t ninodes; } g_cache;
+
+static void cache_open(void) {
+    int fd = open(g_cache_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_uid == geteuid() && st.st_size >= (off_t)sizeof(cache_header_t);
+    char *map = ok ? mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) return;
+    const cache_header_t *h = (const cache_header_t *)map;
+    uint64_t need = sizeof(*h) + (uint64_t)h->nprocs * sizeof(cache_proc_t) + h->ninodes * sizeof(uint32_t);
+    if (memcmp(h->magic, CACHE_MAGIC, 8) != 0 || h->version != CACHE_VERSION || h->ninodes > UINT32_MAX || need != (uint64_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        return;
+    }
+    g_cache.map = map;
+    g_cache.size = (size_t)st.st_size;
+    g_cache.procs = (const cache_proc_t *)(map + sizeof(*h));
+    g_cache.nprocs = h->nprocs;
+    g_cache.inodes = (const uint32_t *)(g_cache.procs + h->nprocs);
+    g_cache.ninodes = h->ninodes;
+}
+
+// --cache only serves a /proc walk that records every process; the paths
+// that don't walk say so instead of ignoring it silently
+static void cache_unused(const char *why) {
+    if (g_cache_path) fprintf(stderr, "ports: --cache %s not used: %s\n", g_cache_path, why);
+}
+
+static void cache_close(void) {
+    if (g_cache.map) munmap(g_cache.map, g_cache.size);
+    memset(&g_cache, 0, sizeof(g_cache));
+}
+
+static const cache_proc_t *cache_find(pid_t pid) {
+    size_t lo = 0, hi = g_cache.nprocs;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (g_cache.procs[mid].pid < pid) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < g_cache.nprocs && g_cache.procs[lo].pid == pid ? &g_cache.procs[lo] : NULL;
+}
+
+// start time of pid in clock ticks after boot, 0 if unknown
+static uint64_t proc_start_time(pid_t pid) {
+    char path[512], buf[1024];
+    snprintf(path, sizeof(path), "%s/%d/stat", g_proc_root, (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return 0;
+    buf[n] = 0;
+    // the comm may hold spaces and parentheses; fields restart after the last ')'
+    const char *p = strrchr(buf, ')');
+    for (int f = 2; p && f < 22; ++f) p = strchr(p + 1, ' ');
+    return p ? strtoull(p + 1, NULL, 10) : 0;
+}
+
+// look pid up; fills out's identity and returns its record when unchanged
+static const cache_proc_t *cache_lookup(pid_t pid, pid_scan_t *out) {
+    char path[512];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%d/fd", g_proc_root, (int)pid);
+    out->start = proc_start_time(pid);
+    out->nfds = out->start && stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+    if (!out->nfds) return NULL;
+    const cache_proc_t *c = cache_find(pid);
+    if (!c || c->start != out->start || c->nfds != out->nfds || c->first + c->count > g_cache.ninodes) return NULL;
+    out->cached = c;
+    return c;
+}
+
+static int cmp_cache_proc(const void *a, const void *b) {
+    const cache_proc_t *x = a, *y = b;
+    return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+// write what this run learned: every walked pid, and the cached records that
+// were still valid; pids[k] goes with results[k]
+static void cache_save(const pid_t *pids, const pid_scan_t *results, size_t npids) {
+    size_t ninodes = 0, nprocs = 0;
+    for (size_t k = 0; k < npids; ++k) {
+        const pid_scan_t *r = &results[k];
+        if (r->walked && r->start && r->nfds) { ninodes += r->n; ++nprocs; }
+        else if (r->cached) { ninodes += r->cached->count; ++nprocs; }
+    }
+    cache_header_t h = { CACHE_MAGIC, CACHE_VERSION, (uint32_t)nprocs, ninodes };
+    cache_proc_t *procs = calloc(nprocs ? nprocs : 1, sizeof(*procs));
+    uint32_t *inodes = malloc((ninodes ? ninodes : 1) * sizeof(*inodes));
+    if (!procs || !inodes) { free(procs); free(inodes); return; }
+    size_t np = 0, ni = 0;
+    for (size_t k = 0; k < npids; ++k) {
+        const pid_scan_t *r = &results[k];
+        cache_proc_t *c = &procs[np];
+        if (r->walked && r->start && r->nfds) {
+            *c = (cache_proc_t){ (int32_t)pids[k], (uint32_t)r->n, r->start, r->nfds, ni, "" };
+            if (r->proc && strlen(r->proc->name) < sizeof(c->name)) memcpy(c->name, r->proc->name, strlen(r->proc->name) + 1);
+            memcpy(inodes + ni, r->match, r->n * sizeof(*inodes));
+        } else if (r->cached) {
+            *c = *r->cached;
+            c->first = ni;
+            memcpy(inodes + ni, g_cache.inodes + r->cached->first, c->count * sizeof(*inodes));
+        } else continue;
+        ni += c->count;
+        ++np;
+    }
+    qsort(procs, np, sizeof(*procs), cmp_cache_proc);
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.%d", g_cache_path, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+    bool ok = f && fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(procs, sizeof(*procs), np, f) == np &&
+              fwrite(inodes, sizeof(*inodes), ni, f) == ni;
+    if (f) ok = fclose(f) == 0 && ok;
+    else if (fd >= 0) close(fd);
+    if (fd >= 0 && (!ok || rename(tmp, g_cache_path) != 0)) unlink(tmp);
+    free(procs);
+    free(inodes);
+}
+
+static void scan_pid_fds(const inode_index_t *idx, owner_goal_t *goal, pid_t pid, pid_scan_t *out) {
+    if (goal_met(goal) || (g_search_pid > 0 && pid != g_search_pid)) return;
+    out->st.pids++;
+    // the cache only serves the prescan, which records every socket
+    const cache_proc_t *cached = !idx && g_cache_path ? cache_lookup(pid, out) : NULL;
+    // -n: check the name before walking the fd directory, so processes that
+    // can't match are never scanned (and only matching owners are listed)
+    char name[256] = "";
+    bool have_name = false;
+    if (cached && cached->name[0]) { memcpy(name, cached->name, sizeof(cached->name)); have_name = true; }
+    if (g_names.active) {
+        if (!have_name) { read_proc_name(pid, name, sizeof(name)); out->st.comm_reads++; have_name = true; }
+        if (!name_match(&g_names, name))
+            return;
+    }
+    if (cached) {
+        out->st.cache_hits++;
+        for (uint32_t i = 0; i < cached->count; ++i)
+            if (pid_scan_proc(out, pid, have_name ? name : NULL)) pid_scan_push(out, g_cache.inodes[cached->first + i]);
+        return;
+    }
+
+    char fdpath[512]; snprintf(fdpath, sizeof(fdpath), "%s/%d/fd", g_proc_root, (int)pid);
+    int dirfd = open(fdpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) { if (errno == EACCES) out->st.eacces++; return; }
+    char *dents = malloc(DENTS_BUF);
+    if (!dents) { close(dirfd); return; }
+
+    // the fd directory is resolved once; every link is read relative to it
+    long nread = -1;
+    for (long pos = 0, len = 0; ; pos += ((struct linux_dirent64 *)(dents + pos))->d_reclen) {
+        if (pos >= len) {
+            if ((nread = sys_getdents64(dirfd, dents, DENTS_BUF)) <= 0) break;
+            pos = 0; len = nread;
+        }
+        const char *fdname = ((struct linux_dirent64 *)(dents + pos))->d_name;
+        if (fdname[0] == '.') continue;  // "." and ".."
+        if (goal_met(goal)) break;
+        out->st.fds++;
+        // "socket:[4294967295]" fits; longer targets are truncated and can't be sockets
+        char target[32];
+        out->st.readlinks++;
+        ssize_t r = readlinkat(dirfd, fdname, target, sizeof(target));
+        if (r < 0 && errno == EACCES) out->st.eacces++;
+        if (r <= 8 || memcmp(target, "socket:[", 8) != 0) continue;
+        unsigned long inode = 0; ssize_t k = 8;
+        while (k < r && target[k] >= '0' && target[k] <= '9') inode = inode * 10 + (unsigned)(target[k++] - '0');
+        if (k == 8 || k >= r || target[k] != ']') continue;
+        if (!idx) {
+            // prescan: the rows aren't known yet, keep every socket
+            if (pid_scan_proc(out, pid, have_name ? name : NULL)) pid_scan_push(out, (uint32_t)inode);
+            continue;
+        }
+        size_t before = out->n;
+
+        // find matching entries via the inode index
+        for (size_t i = inode_hash(inode) & idx->mask; idx->slots[i].inode; i = (i + 1) & idx->mask) {
+            if (idx->slots[i].inode != inode || !goal_claim(goal, i))
+                continue;
+            if (!pid_scan_proc(out, pid, have_name ? name : NULL))
+                break;
+            pid_scan_push(out, idx->slots[i].row);
+        }
+        if (out->n > before) out->st.inode_hits++; else out->st.inode_misses++;
+    }
+    out->walked = nread == 0;  // a failed getdents leaves the list incomplete
+    free(dents);
+    close(dirfd);
+}
+
+// collect numeric /proc entries in directory order
+static size_t list_pids(pid_t **out) {
+    *out = NULL;
+    int dirfd = open(g_proc_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC); if (dirfd < 0) return 0;
+    char *dents = malloc(DENTS_BUF); if (!dents) { close(dirfd); return 0; }
+    size_t n = 0, cap = 0;
+    long nread;
+    for (long pos = 0, len = 0; ; pos += ((struct linux_dirent64 *)(dents + pos))->d_reclen) {
+        if (pos >= len) {
+            if ((nread = sys_getdents64(dirfd, dents, DENTS_BUF)) <= 0) break;
+            pos = 0; len = nread;
+        }
+        const char *name = ((struct linux_dirent64 *)(dents + pos))->d_name;
+        char *endptr; long pid = strtol(name, &endptr, 10); if (*endptr || endptr == name) continue;
+        if (n == cap) {
+            size_t nc = cap ? cap * 2 : 256;
+            pid_t *np = realloc(*out, nc * sizeof(*np));
+            if (!np) break;
+            *out = np; cap = nc;
+        }
+        (*out)[n++] = (pid_t)pid;
+    }
+    free(dents);
+    close(dirfd);
+    return n;
+}
+
+// work-stealing scan: every worker starts with a contiguous share of the pid
+// list and pops from its front; once empty it steals the back half of another
+// worker's remaining range. Each queue has its own lock, so contention only
+// happens between an owner and a thief, never on a global structure.
+typedef struct { pthread_mutex_t lock; size_t lo, hi; } scan_queue_t;
+
+typedef struct {
+    const inode_index_t *idx;
+    owner_goal_t *goal;
+    const pid_t *pids;
+    pid_scan_t *results;
+    scan_queue_t *queues;
+    int nworkers;
+} scan_ctx_t;
+
+typedef struct { scan_ctx_t *ctx; int id; bool started; } scan_worker_t;
+
+static bool scan_queue_pop(scan_queue_t *q, size_t *k) {
+    bool ok = false;
+    pthread_mutex_lock(&q->lock);
+    if (q->lo < q->hi) { *k = q->lo++; ok = true; }
+    pthread_mutex_unlock(&q->lock);
+    return ok;
+}
+
+static bool scan_steal(scan_ctx_t *ctx, int self) {
+    for (int v = 1; v < ctx->nworkers; ++v) {
+        scan_queue_t *victim = &ctx->queues[(self + v) % ctx->nworkers];
+        size_t lo = 0, hi = 0;
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->hi - victim->lo;
+        if (left) {
+            hi = victim->hi;
+            lo = hi - (left + 1) / 2;
+            victim->hi = lo;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (hi > lo) {
+            scan_queue_t *own = &ctx->queues[self];
+            pthread_mutex_lock(&own->lock);
+            own->lo = lo; own->hi = hi;
+            pthread_mutex_unlock(&own->lock);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *scan_worker(void *arg) {
+    scan_worker_t *w = arg;
+    scan_ctx_t *ctx = w->ctx;
+    size_t k;
+    for (;;) {
+        while (scan_queue_pop(&ctx->queues[w->id], &k))
+            scan_pid_fds(ctx->idx, ctx->goal, ctx->pids[k], &ctx->results[k]);
+        // no work is ever added, so a full pass over empty victims means done
+        if (!scan_steal(ctx, w->id))
+            break;
+    }
+    return NULL;
+}
+
+static void run_scan_workers(scan_ctx_t *ctx, size_t npids) {
+    scan_worker_t *workers = calloc(ctx->nworkers, sizeof(*workers));
+    pthread_t *threads = calloc(ctx->nworkers, sizeof(*threads));
+    ctx->queues = calloc(ctx->nworkers, sizeof(*ctx->queues));
+    if (!workers || !threads || !ctx->queues) {
+        free(workers); free(threads); free(ctx->queues);
+        ctx->queues = NULL;
+        for (size_t k = 0; k < npids; ++k) scan_pid_fds(ctx->idx, ctx->goal, ctx->pids[k], &ctx->results[k]);
+        return;
+    }
+
+    for (int t = 0; t < ctx->nworkers; ++t) {
+        pthread_mutex_init(&ctx->queues[t].lock, NULL);
+        ctx->queues[t].lo = npids * t / ctx->nworkers;
+        ctx->queues[t].hi = npids * (t + 1) / ctx->nworkers;
+        workers[t] = (scan_worker_t){ ctx, t, false };
+    }
+    // worker 0 runs on the calling thread; a failed spawn just leaves its
+    // share to be stolen by the others
+    for (int t = 1; t < ctx->nworkers; ++t)
+        workers[t].started = pthread_create(&threads[t], NULL, scan_worker, &workers[t]) == 0;
+    scan_worker(&workers[0]);
+    for (int t = 1; t < ctx->nworkers; ++t)
+        if (workers[t].started) pthread_join(threads[t], NULL);
+
+    for (int t = 0; t < ctx->nworkers; ++t) pthread_mutex_destroy(&ctx->queues[t].lock);
+    free(ctx->queues); ctx->queues = NULL;
+    free(threads);
+    free(workers);
+}
+
+// attach one pid's matches to the table and hand its record to *procs
+static void apply_pid_scan(sock_table_t *t, pid_scan_t *r, proc_info_t **procs) {
+    stats_merge(&g_stats, &r->st);
+    if (r->proc) {
+        r->proc->next = *procs;
+        *procs = r->proc;
+        for (size_t m = 0; m < r->n; ++m) add_owner(t, r->match[m], r->proc);
     }
+    free(r->match);
+    memset(r, 0, sizeof(*r));
+}
+
+// raw bpf(2) program building, shared by the task/file iterator below and
+// the tracepoint used by -e
+#define BPF_INSN(c, d, s_, o, i) ((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s_), .off = (o), .imm = (i) })
+#define I_MOV_REG(d, s_)     BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, d, s_, 0, 0)
+#define I_MOV_IMM(d, i)      BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, d, 0, 0, i)
+#define I_ADD_IMM(d, i)      BPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, d, 0, 0, i)
+#define I_RSH_IMM(d, i)      BPF_INSN(BPF_ALU64 | BPF_RSH | BPF_K, d, 0, 0, i)
+#define I_LDX(sz, d, s_, o)  BPF_INSN(BPF_LDX | (sz) | BPF_MEM, d, s_, o, 0)
+#define I_STX(sz, d, s_, o)  BPF_INSN(BPF_STX | (sz) | BPF_MEM, d, s_, o, 0)
+#define I_AND_IMM(d, i)      BPF_INSN(BPF_ALU64 | BPF_AND | BPF_K, d, 0, 0, i)
+#define I_JNE_IMM(d, i, o)   BPF_INSN(BPF_JMP | BPF_JNE | BPF_K, d, 0, o, i)
+#define I_JEQ_IMM(d, i, o)   BPF_INSN(BPF_JMP | BPF_JEQ | BPF_K, d, 0, o, i)
+#define I_CALL(f)            BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, f)
+#define I_EXIT()             BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+static long sys_bpf(int cmd, union bpf_attr *attr) { return syscall(__NR_bpf, cmd, attr, sizeof(*attr)); }
 
-    sock_entry_t *head = NULL;
-    // default: only LISTEN (0A); show all if requested
-    parse_proc_net(&head, "/proc/net/tcp", "tcp", !g_show_all);
-    parse_proc_net(&head, "/proc/net/tcp6", "tcp6", !g_show_all);
-    parse_proc_net(&head, "/proc/net/udp", "udp", !g_show_all);
-    parse_proc_net(&head, "/proc/net/udp6", "udp6", !g_show_all);
+// vmlinux BTF, just enough of it to find a function and struct member offsets
+typedef struct { char *data; size_t size; bool mapped; const struct btf_type **types; uint32_t ntypes; const char *strs; uint32_t str_len; } btf_t;
+
+static void btf_free(btf_t *b) {
+    if (b->mapped) munmap(b->data, b->size); else free(b->data);
+    free(b->types);
+    memset(b, 0, sizeof(*b));
+}
+
+// mapped when the kernel allows it (6.15+ maps vmlinux BTF read-only), read otherwise
+static bool btf_load(btf_t *b, const char *path) {
+    memset(b, 0, sizeof(*b));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || sb.st_size < (off_t)sizeof(struct btf_header)) { close(fd); return false; }
+    size_t have = 0;
+    b->size = (size_t)sb.st_size;
+    void *m = mmap(NULL, b->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m != MAP_FAILED) {
+        b->data = m; b->mapped = true; have = b->size;
+    } else if ((b->data = malloc(b->size)) != NULL) {
+        while (have < b->size) {
+            ssize_t r = read(fd, b->data + have, b->size - have);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) break;
+            have += (size_t)r;
+        }
+    }
+    close(fd);
+    if (!b->data) return false;
+    const struct btf_header *h = (const struct btf_header *)b->data;
+    if (have != b->size || h->magic != BTF_MAGIC || (size_t)h->hdr_len + h->type_off + h->type_len > have ||
+        (size_t)h->hdr_len + h->str_off + h->str_len > have) { btf_free(b); return false; }
+    b->strs = b->data + h->hdr_len + h->str_off;
+    b->str_len = h->str_len;
 
-    populate_owners(head);
+    // type ids start at 1; index every record by walking the variable-size tails
+    const char *p = b->data + h->hdr_len + h->type_off, *end = p + h->type_len;
+    size_t cap = 1 << 16;
+    b->types = malloc(cap * sizeof(*b->types));
+    b->ntypes = 1;
+    while (b->types && p + sizeof(struct btf_type) <= end) {
+        const struct btf_type *t = (const struct btf_type *)p;
+        size_t vlen = BTF_INFO_VLEN(t->info), tail = 0;
+        switch (BTF_INFO_KIND(t->info)) {
+        case BTF_KIND_INT: case BTF_KIND_VAR: case BTF_KIND_DECL_TAG: tail = 4; break;
+        case BTF_KIND_ARRAY: tail = sizeof(struct btf_array); break;
+        case BTF_KIND_STRUCT: case BTF_KIND_UNION: tail = vlen * sizeof(struct btf_member); break;
+        case BTF_KIND_ENUM: tail = vlen * sizeof(struct btf_enum); break;
+        case BTF_KIND_FUNC_PROTO: tail = vlen * sizeof(struct btf_param); break;
+        case BTF_KIND_DATASEC: tail = vlen * sizeof(struct btf_var_secinfo); break;
+        case BTF_KIND_ENUM64: tail = vlen * sizeof(struct btf_enum64); break;
+        case BTF_KIND_PTR: case BTF_KIND_FWD: case BTF_KIND_TYPEDEF: case BTF_KIND_VOLATILE: case BTF_KIND_CONST:
+        case BTF_KIND_RESTRICT: case BTF_KIND_FUNC: case BTF_KIND_FLOAT: case BTF_KIND_TYPE_TAG: break;
+        default: btf_free(b); return false;  // a kind we don't know the size of
+        }
+        if (b->ntypes == cap) {
+            const struct btf_type **nt = realloc(b->types, cap * 2 * sizeof(*nt));
+            if (!nt) break;
+            b->types = nt; cap *= 2;
+        }
+        b->types[b->ntypes++] = t;
+        p += sizeof(*t) + tail;
+    }
+    if (!b->types || p != end) { btf_free(b); return false; }
+    return true;
+}
 
-    print_entries(head);
+static const char *btf_name(const btf_t *b, uint32_t off) { return off < b->str_len ? b->strs + off : ""; }
 
-    free_entries(head);
+// id of the named type of this kind, or 0
+static uint32_t btf_find(const btf_t *b, const char *name, int kind) {
+    for (uint32_t id = 1; id < b->ntypes; ++id)
+        if ((int)BTF_INFO_KIND(b->types[id]->info) == kind && strcmp(btf_name(b, b->types[id]->name_off), name) == 0)
+            return id;
     return 0;
 }
 
+// byte offset of a member of struct/union id, looking into anonymous
+// struct/union members as the kernel's own layouts often nest them; -1 if absent
+static long btf_member_offset(const btf_t *b, uint32_t id, const char *name) {
+    if (!id || id >= b->ntypes) return -1;
+    const struct btf_type *t = b->types[id];
+    int kind = BTF_INFO_KIND(t->info);
+    if (kind != BTF_KIND_STRUCT && kind != BTF_KIND_UNION) return -1;
+    const struct btf_member *m = (const struct btf_member *)(t + 1);
+    for (uint32_t i = 0; i < BTF_INFO_VLEN(t->info); ++i) {
+        uint32_t bits = BTF_INFO_KFLAG(t->info) ? BTF_MEMBER_BIT_OFFSET(m[i].offset) : m[i].offset;
+        if (m[i].name_off) {
+            if (strcmp(btf_name(b, m[i].name_off), name) == 0) return bits % 8 ? -1 : (long)(bits / 8);
+            continue;
+        }
+        long inner = btf_member_offset(b, m[i].type, name);
+        if (inner >= 0) return bits % 8 ? -1 : (long)(bits / 8) + inner;
+    }
+    return -1;
+}
+
+// kernel-side owner attribution: a BPF_TRACE_ITER program on the task/file
+// iterator writes one record per socket fd of every process, read back from
+// an iterator fd in large chunks, so no /proc/<pid>/fd directory is opened.
+// The program and link are built once per process; every populate_owners()
+// call only creates a fresh iterator. Needs root and a kernel with BTF and
+// bpf_iter (5.8+); any failure leaves the fd walk in charge, and
+// PORTS_NO_BPF_ITER=1 disables it.
+typedef struct { uint64_t inode; uint32_t tgid, tid; char comm[16]; } iter_rec_t;
+
+static int g_iter_link = -1;         // BPF link of the loaded iterator, or -1
+static bool g_iter_tried = false;    // only try to load it once
+
+static int iter_link_open(void) {
+    const char *off = getenv("PORTS_NO_BPF_ITER");
+    if (off && *off && strcmp(off, "0") != 0) return -1;
+    btf_t b;
+    if (!btf_load(&b, "/sys/kernel/btf/vmlinux")) return -1;
+    uint32_t fn = btf_find(&b, "bpf_iter_task_file", BTF_KIND_FUNC);
+    uint32_t task = btf_find(&b, "task_struct", BTF_KIND_STRUCT), file = btf_find(&b, "file", BTF_KIND_STRUCT), ino = btf_find(&b, "inode", BTF_KIND_STRUCT);
+    long o_tgid = btf_member_offset(&b, task, "tgid"), o_pid = btf_member_offset(&b, task, "pid"), o_comm = btf_member_offset(&b, task, "comm");
+    long o_finode = btf_member_offset(&b, file, "f_inode"), o_mode = btf_member_offset(&b, ino, "i_mode"), o_ino = btf_member_offset(&b, ino, "i_ino");
+    btf_free(&b);
+    if (!fn || o_tgid < 0 || o_pid < 0 || o_comm < 0 || o_finode < 0 || o_mode < 0 || o_ino < 0) return -1;
+
+    // ctx is struct bpf_iter__task_file { meta; task; u32 fd; file; }, meta->seq at 0.
+    // r6 = ctx, r7 = task, r8 = inode; the record is built on the stack at r10 + S
+    enum { S = -(int)sizeof(iter_rec_t) };
+    struct bpf_insn prog[40];
+    int n = 0, jumps[8], nj = 0;
+    prog[n++] = I_MOV_REG(BPF_REG_6, BPF_REG_1);
+    prog[n++] = I_LDX(BPF_DW, BPF_REG_7, BPF_REG_6, 8);
+    jumps[nj++] = n; prog[n++] = I_JEQ_IMM(BPF_REG_7, 0, 0);
+    prog[n++] = I_LDX(BPF_DW, BPF_REG_2, BPF_REG_6, 24);
+    jumps[nj++] = n; prog[n++] = I_JEQ_IMM(BPF_REG_2, 0, 0);
+    prog[n++] = I_LDX(BPF_DW, BPF_REG_8, BPF_REG_2, (short)o_finode);
+    jumps[nj++] = n; prog[n++] = I_JEQ_IMM(BPF_REG_8, 0, 0);
+    prog[n++] = I_LDX(BPF_H, BPF_REG_2, BPF_REG_8, (short)o_mode);
+    prog[n++] = I_AND_IMM(BPF_REG_2, S_IFMT);
+    jumps[nj++] = n; prog[n++] = I_JNE_IMM(BPF_REG_2, S_IFSOCK, 0);
+    prog[n++] = I_LDX(BPF_DW, BPF_REG_2, BPF_REG_8, (short)o_ino);
+    prog[n++] = I_STX(BPF_DW, BPF_REG_10, BPF_REG_2, S + (int)offsetof(iter_rec_t, inode));
+    prog[n++] = I_LDX(BPF_W, BPF_REG_2, BPF_REG_7, (short)o_tgid);
+    prog[n++] = I_STX(BPF_W, BPF_REG_10, BPF_REG_2, S + (int)offsetof(iter_rec_t, tgid));
+    prog[n++] = I_LDX(BPF_W, BPF_REG_2, BPF_REG_7, (short)o_pid);
+    prog[n++] = I_STX(BPF_W, BPF_REG_10, BPF_REG_2, S + (int)offsetof(iter_rec_t, tid));
+    prog[n++] = I_LDX(BPF_DW, BPF_REG_2, BPF_REG_7, (short)o_comm);
+    prog[n++] = I_STX(BPF_DW, BPF_REG_10, BPF_REG_2, S + (int)offsetof(iter_rec_t, comm));
+    prog[n++] = I_LDX(BPF_DW, BPF_REG_2, BPF_REG_7, (short)(o_comm + 8));
+    prog[n++] = I_STX(BPF_DW, BPF_REG_10, BPF_REG_2, S + (int)offsetof(iter_rec_t, comm) + 8);
+    prog[n++] = I_LDX(BPF_DW, BPF_REG_1, BPF_REG_6, 0);
+    prog[n++] = I_LDX(BPF_DW, BPF_REG_1, BPF_REG_1, 0);
+    prog[n++] = I_MOV_REG(BPF_REG_2, BPF_REG_10);
+    prog[n++] = I_ADD_IMM(BPF_REG_2, S);
+    prog[n++] = I_MOV_IMM(BPF_REG_3, sizeof(iter_rec_t));
+    prog[n++] = I_CALL(BPF_FUNC_seq_write);
+    int out = n;
+    prog[n++] = I_MOV_IMM(BPF_REG_0, 0);
+    prog[n++] = I_EXIT();
+    for (int j = 0; j < nj; ++j) prog[jumps[j]].off = (short)(out - jumps[j] - 1);
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_TRACING;
+    attr.expected_attach_type = BPF_TRACE_ITER;
+    attr.attach_btf_id = fn;
+    attr.insns = (uint64_t)(uintptr_t)prog;
+    attr.insn_cnt = (uint32_t)n;
+    attr.license = (uint64_t)(uintptr_t)"Dual MIT/GPL";
+    int prog_fd = (int)sys_bpf(BPF_PROG_LOAD, &attr);
+    if (prog_fd < 0) return -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = (uint32_t)prog_fd;
+    attr.link_create.attach_type = BPF_TRACE_ITER;
+    int link = (int)sys_bpf(BPF_LINK_CREATE, &attr);
+    close(prog_fd);  // the link keeps the program alive
+    return link;
+}
 
+// Owners from the iterator, or false if it is unavailable. Records come per
+// task in pid order and per fd in fd order, the same order the /proc walk
+// sees, and only thread-group leaders count (/proc/<pid>/fd is the leader's
+// table), so the owner lists match the fd walk's.
+static bool iter_available(void) {
+    if (!g_iter_tried) { g_iter_tried = true; g_iter_link = iter_link_open(); }
+    return g_iter_link >= 0;
+}
+
+// Without an index every socket fd is a match, its inode stored in the
+// result as the prescan does. *out gets one result per process with a match.
+static bool iter_scan(const inode_index_t *idx, owner_goal_t *goal, pid_scan_t **out, size_t *nout) {
+    *out = NULL; *nout = 0;
+    if (!iter_available()) return false;
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.iter_create.link_fd = (uint32_t)g_iter_link;
+    int fd = (int)sys_bpf(BPF_ITER_CREATE, &attr);
+    if (fd < 0) return false;
+
+    size_t buflen = 1 << 16, have = 0, nres = 0, cap = 0;
+    char *buf = malloc(buflen);
+    pid_scan_t *res = NULL;
+    long cur = -1;              // res slot of the current process, once it matched
+    uint32_t tgid = 0;
+    bool ok = buf != NULL, skip = false, any = false;
+    while (ok && !goal_met(goal)) {
+        ssize_t r = read(fd, buf + have, buflen - have);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) { ok = false; break; }
+        if (r == 0) break;
+        have += (size_t)r;
+
+        size_t nrec = have / sizeof(iter_rec_t);
+        for (size_t k = 0; ok && k < nrec && !goal_met(goal); ++k) {
+            iter_rec_t rec;
+            memcpy(&rec, buf + k * sizeof(rec), sizeof(rec));
+            if (rec.tid != rec.tgid) continue;
+            rec.comm[sizeof(rec.comm) - 1] = 0;
+            if (!any || rec.tgid != tgid) {
+                // a new process; -n is checked once, on its comm
+                any = true; tgid = rec.tgid; cur = -1;
+                g_stats.pids++;
+                skip = (g_search_pid > 0 && (pid_t)rec.tgid != g_search_pid) ||
+                       !name_match(&g_names, rec.comm);
+            }
+            if (skip) continue;
+            g_stats.fds++;
+
+            bool hit = false;
+            for (size_t i = idx ? inode_hash(rec.inode) & idx->mask : 0; !idx || idx->slots[i].inode; i = (i + 1) & idx->mask) {
+                if (idx && (idx->slots[i].inode != rec.inode || !goal_claim(goal, i)))
+                    continue;
+                if (cur < 0) {
+                    if (nres == cap) {
+                        size_t nc = cap ? cap * 2 : 64;
+                        pid_scan_t *nr = realloc(res, nc * sizeof(*nr));
+                        if (!nr) { ok = false; break; }
+                        res = nr; cap = nc;
+                    }
+                    pid_scan_t *ps = &res[nres];
+                    memset(ps, 0, sizeof(*ps));
+                    if (!(ps->proc = malloc(sizeof(*ps->proc)))) { ok = false; break; }
+                    ps->proc->pid = (pid_t)rec.tgid;
+                    ps->proc->gen = 0;
+                    ps->proc->name_gen = 0;
+                    ps->proc->next = NULL;
+                    snprintf(ps->proc->name, sizeof(ps->proc->name), "%s", rec.comm);
+                    read_proc_cols(ps->proc, &g_stats);
+                    cur = (long)nres++;
+                }
+                if (!idx) { pid_scan_push(&res[cur], (uint32_t)rec.inode); break; }
+                pid_scan_push(&res[cur], idx->slots[i].row);
+                hit = true;
+            }
+            if (!idx) continue;
+            if (hit) g_stats.inode_hits++; else g_stats.inode_misses++;
+        }
+        size_t used = nrec * sizeof(iter_rec_t);
+        have -= used;
+        memmove(buf, buf + used, have);
+    }
+    close(fd);
+    free(buf);
+
+    if (!ok) {
+        for (size_t k = 0; k < nres; ++k) { proc_info_free(res[k].proc); free(res[k].match); }
+        free(res);
+        return false;
+    }
+    *out = res;
+    *nout = nres;
+    return true;
+}
+
+static bool iter_owners(sock_table_t *t, const inode_index_t *idx, owner_goal_t *goal, proc_info_t **procs) {
+    pid_scan_t *res;
+    size_t nres;
+    if (!iter_scan(idx, goal, &res, &nres)) return false;
+    for (size_t k = 0; k < nres; ++k) apply_pid_scan(t, &res[k], procs);
+    free(res);
+    return true;
+}
+
+// fd walk of every listed pid into results[], on nthreads threads
+static void scan_pids(const inode_index_t *idx, owner_goal_t *goal, const pid_t *pids, size_t npids, pid_scan_t *results, int nthreads) {
+    if (nthreads > (int)npids) nthreads = npids ? (int)npids : 1;
+    if (nthreads <= 1) {
+        for (size_t k = 0; k < npids && !goal_met(goal); ++k) scan_pid_fds(idx, goal, pids[k], &results[k]);
+    } else {
+        scan_ctx_t ctx = { idx, goal, pids, results, NULL, nthreads };
+        run_scan_workers(&ctx, npids);
+    }
+}
+
+// populate owners by scanning /proc/<pid>/fd for socket:[inode]
+static void populate_owners(sock_table_t *t, const inode_index_t *idx, proc_info_t **procs, int nthreads) {
+    if (!idx->slots || !idx->n) return;  // nothing requested: no scan at all
+    owner_goal_t goal_store, *goal = NULL;
+    if (g_first_owner) {
+        goal_store.claimed = calloc(idx->mask + 1, sizeof(*goal_store.claimed));
+        if (goal_store.claimed) { atomic_init(&goal_store.remaining, idx->n); goal = &goal_store; }
+    }
+
+    // the kernel-side iterator only sees the live system
+    if (strcmp(g_proc_root, "/proc") == 0 && iter_owners(t, idx, goal, procs)) goto out;
+    pid_t *pids = NULL;
+    size_t npids = list_pids(&pids);
+    pid_scan_t *results = calloc(npids ? npids : 1, sizeof(*results));
+    if (!results) { free(pids); goto out; }
+    scan_pids(idx, goal, pids, npids, results, nthreads);
+
+    // merge in /proc order: same owner lists as a single-threaded scan
+    for (size_t k = 0; k < npids; ++k) apply_pid_scan(t, &results[k], procs);
+    free(results);
+    free(pids);
+out:
+    if (goal) free(goal->claimed);
+}
+
+// The fd walk doesn't need the socket tables until its links are matched to
+// rows, so the one-shot report starts it before reading them: a thread walks
+// /proc (with -J workers of its own) and records the socket inodes of every
+// process while the tables are read. join_owner_prescan() then matches them
+// against the finished index per pid in /proc order and per fd in fd order,
+// which attaches exactly the owners populate_owners() would.
+typedef struct { pid_t *pids; size_t npids; pid_scan_t *results; int nthreads; pthread_t thread; bool started; } owner_prescan_t;
+
+static void *owner_prescan_run(void *arg) {
+    owner_prescan_t *ps = arg;
+    ps->npids = list_pids(&ps->pids);
+    ps->results = calloc(ps->npids ? ps->npids : 1, sizeof(*ps->results));
+    if (ps->results) scan_pids(NULL, NULL, ps->pids, ps->npids, ps->results, ps->nthreads);
+    return NULL;
+}
+
+static void start_owner_prescan(owner_prescan_t *ps, int nthreads) {
+    memset(ps, 0, sizeof(*ps));
+    ps->nthreads = nthreads;
+    ps->started = pthread_create(&ps->thread, NULL, owner_prescan_run, ps) == 0;
+}
+
+// wait for the walk and attach its sockets to the rows in idx; a walk that
+// hasn't started (no spare CPU) runs now, unless there is nothing to match
+static void join_owner_prescan(owner_prescan_t *ps, sock_table_t *t, const inode_index_t *idx, proc_info_t **procs) {
+    if (ps->started) pthread_join(ps->thread, NULL);
+    else if (idx->n) owner_prescan_run(ps);
+    if (g_cache_path && ps->results) cache_save(ps->pids, ps->results, ps->npids);
+    for (size_t k = 0; ps->results && k < ps->npids; ++k) {
+        pid_scan_t *r = &ps->results[k];
+        stats_merge(&g_stats, &r->st);
+        bool owns = false;
+        for (size_t m = 0; m < r->n; ++m) {
+            bool hit = false;
+            for (size_t i = inode_hash(r->match[m]) & idx->mask; idx->slots && idx->slots[i].inode; i = (i + 1) & idx->mask)
+                if (idx->slots[i].inode == r->match[m]) { add_owner(t, idx->slots[i].row, r->proc); hit = true; }
+            if (hit) g_stats.inode_hits++; else g_stats.inode_misses++;
+            owns |= hit;
+        }
+        if (owns) { r->proc->next = *procs; *procs = r->proc; }
+        else proc_info_free(r->proc);
+        free(r->match);
+    }
+    free(ps->results);
+    free(ps->pids);
+}
+
+// every row goes through one large buffer that is handed to stdout in big
+// writes, and fields are formatted by hand instead of a printf per field.
+// The buffer is flushed whenever it fills, so output streams and memory
+// stays flat however many rows are printed.
+#define OUT_BUF_SIZE (1u << 20)
+static char g_out[OUT_BUF_SIZE];
+static size_t g_out_len;
+
+static void out_flush(void) {
+    if (g_out_len) fwrite(g_out, 1, g_out_len, stdout);
+    g_out_len = 0;
+}
+
+static inline char *out_room(size_t n) {
+    if (OUT_BUF_SIZE - g_out_len < n) out_flush();
+    return g_out + g_out_len;
+}
+
+static void out_mem(const char *p, size_t n) {
+    while (n) {
+        char *o = out_room(n < 4096 ? n : 4096);
+        size_t k = OUT_BUF_SIZE - g_out_len < n ? OUT_BUF_SIZE - g_out_len : n;
+        memcpy(o, p, k);
+        g_out_len += k; p += k; n -= k;
+    }
+}
+
+static void out_str(const char *s) { out_mem(s, strlen(s)); }
+
+static inline void out_char(char c) { *out_room(1) = c; ++g_out_len; }
+
+// left-justified in width, like "%-*s"
+static void out_pad(const char *s, size_t len, size_t width) {
+    out_mem(s, len);
+    if (len < width) { char *o = out_room(width - len); memset(o, ' ', width - len); g_out_len += width - len; }
+}
+
+static size_t format_u64(uint64_t v, char *out) {
+    char tmp[20]; size_t n = 0;
+    do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while (v);
+    for (size_t i = 0; i < n; ++i) out[i] = tmp[n - 1 - i];
+    return n;
+}
+
+static void out_u64(uint64_t v, size_t width) { char b[20]; out_pad(b, format_u64(v, b), width); }
+
+static void out_json_str(const char *s) {
+    static const char hex[] = "0123456789abcdef";
+    out_char('"');
+    for (const unsigned char *p = (const unsigned char *)s; *p; ++p) {
+        if (*p == '"' || *p == '\\') { char *o = out_room(2); o[0] = '\\'; o[1] = (char)*p; g_out_len += 2; }
+        else if (*p < 0x20) { char *o = out_room(6); memcpy(o, "\\u00", 4); o[4] = hex[*p >> 4]; o[5] = hex[*p & 15]; g_out_len += 6; }
+        else out_char((char)*p);
+    }
+    out_char('"');
+}
+
+static void print_header(void) {
+    if (g_format != FORMAT_TABLE) return;
+    bool netns = netns_tagged();
+    out_str("Proto  Port   Local IP        Inode       ");
+    if (netns) out_str("Netns       ");
+    if (g_cols & COL_RXQ) out_str("Recv-Q      ");
+    if (g_cols & COL_TXQ) out_str("Send-Q      ");
+    out_str(netns ? "Owner(s) [cgroup]\n" : "Owner(s)\n");
+    out_str("-----  -----  --------------- ----------  ");
+    if (netns) out_str("----------  ");
+    if (g_cols & COL_RXQ) out_str("----------  ");
+    if (g_cols & COL_TXQ) out_str("----------  ");
+    out_str("----------------------------\n");
+}
+
+// the -o process columns of an owner, after its pid/name
+static void print_proc_cols(const proc_info_t *p) {
+    if (!(g_cols & COL_PROC)) return;
+    const char *sep = " (";
+    if (g_cols & COL_UID) {
+        out_str(sep); sep = " "; out_str("uid=");
+        if (p->uid == (uid_t)-1) out_char('?'); else out_u64(p->uid, 0);
+    }
+    if (g_cols & COL_CGROUP) { out_str(sep); sep = " "; out_str("cgroup="); out_str(p->cgroup ? p->cgroup : "?"); }
+    if (g_cols & COL_CMDLINE) { out_str(sep); out_str("cmdline="); if (p->cmdline) out_json_str(p->cmdline); else out_char('?'); }
+    out_char(')');
+}
+
+static void print_proc_cols_json(const proc_info_t *p) {
+    if (g_cols & COL_UID) {
+        out_str(",\"uid\":");
+        if (p->uid == (uid_t)-1) out_str("null"); else out_u64(p->uid, 0);
+    }
+    if (g_cols & COL_CGROUP) { out_str(",\"cgroup\":"); if (p->cgroup) out_json_str(p->cgroup); else out_str("null"); }
+    if (g_cols & COL_CMDLINE) { out_str(",\"cmdline\":"); if (p->cmdline) out_json_str(p->cmdline); else out_str("null"); }
+}
+
+// -n / --pid select owners: a row is listed if one of its owners matches,
+// and only the matching owners are shown
+static bool owner_filtered(void) { return g_names.active || g_search_pid > 0; }
+
+// the name is matched once per process, not once per socket it owns
+static bool owner_matches(proc_info_t *p) {
+    if (g_search_pid > 0 && p->pid != g_search_pid) return false;
+    if (!g_names.active) return true;
+    if (p->name_gen != g_names.gen) { p->name_hit = name_match(&g_names, p->name); p->name_gen = g_names.gen; }
+    return p->name_hit;
+}
+
+static bool row_matches(const sock_table_t *t, uint32_t r) {
+    if (!g_show_all && t->state[r] != listen_state(t->proto[r])) return false;  // the daemon keeps every state
+    if (g_search_port>0 && t->port[r] != (unsigned)g_search_port) return false;
+    if (owner_filtered()) { bool match=false; for (const owner_info_t *o=t->owners[r];o;o=o->next) if (owner_matches(o->proc)) { match=true; break; } if (!match) return false; }
+    return true;
+}
+
+// kernel TCP state names; UDP sockets report CLOSE (unconnected) or ESTABLISHED
+static const char *const state_names[] = {
+    "UNKNOWN", "ESTABLISHED", "SYN_SENT", "SYN_RECV", "FIN_WAIT1", "FIN_WAIT2", "TIME_WAIT",
+    "CLOSE", "CLOSE_WAIT", "LAST_ACK", "LISTEN", "CLOSING", "NEW_SYN_RECV",
+};
+
+static const char *state_name(uint8_t st) { return st < sizeof(state_names) / sizeof(state_names[0]) ? state_names[st] : "UNKNOWN"; }
+
+// one JSON object, no trailing newline; watch modes tag it with the change
+static void print_row_json(const sock_table_t *t, uint32_t r, const char *prefix) {
+    char ip[INET6_ADDRSTRLEN];
+    size_t iplen = format_addr(t->addr[r], proto_is_v6(t->proto[r]), ip);
+    if (*prefix) out_str(*prefix == '+' ? "{\"event\":\"add\",\"proto\":\"" : "{\"event\":\"remove\",\"proto\":\"");
+    else out_str("{\"proto\":\"");
+    out_str(proto_names[t->proto[r]]);
+    out_str("\",\"state\":\"");
+    out_str(state_name(t->state[r]));
+    out_str("\",\"address\":\"");
+    out_mem(ip, iplen);
+    out_str("\",\"port\":");
+    out_u64(t->port[r], 0);
+    iplen = format_addr(t->raddr[r], proto_is_v6(t->proto[r]), ip);
+    out_str(",\"remote_address\":\"");
+    out_mem(ip, iplen);
+    out_str("\",\"remote_port\":");
+    out_u64(t->rport[r], 0);
+    out_str(",\"inode\":");
+    out_u64(t->inode[r], 0);
+    if (netns_tagged()) {
+        out_str(",\"netns\":");
+        out_u64(g_netns[t->netns[r]].ino, 0);
+        out_str(",\"cgroup\":");
+        out_json_str(g_netns[t->netns[r]].cgroup);
+    }
+    if (g_cols & COL_RXQ) { out_str(",\"rx_queue\":"); out_u64(t->rxq ? t->rxq[r] : 0, 0); }
+    if (g_cols & COL_TXQ) { out_str(",\"tx_queue\":"); out_u64(t->txq ? t->txq[r] : 0, 0); }
+    out_str(",\"owners\":[");
+    bool first = true;
+    for (const owner_info_t *o = t->owners[r]; o; o = o->next) {
+        if (owner_filtered() && !owner_matches(o->proc)) continue;
+        out_str(first ? "{\"pid\":" : ",{\"pid\":"); first = false;
+        out_u64((uint64_t)o->proc->pid, 0);
+        out_str(",\"name\":");
+        out_json_str(o->proc->name);
+        print_proc_cols_json(o->proc);
+        out_char('}');
+    }
+    out_str("]}");
+}
+
+// one row; in table form the prefix ("+ ", "- " in watch modes) leads the line
+static void print_row(const sock_table_t *t, uint32_t r, const char *prefix) {
+    if (g_format != FORMAT_TABLE) {
+        print_row_json(t, r, prefix);
+        if (g_format == FORMAT_NDJSON) out_char('\n');
+        return;
+    }
+    const owner_info_t *owners = t->owners[r];
+    // only rows that survive the filters get their address formatted
+    char ip[INET6_ADDRSTRLEN];
+    size_t iplen = format_addr(t->addr[r], proto_is_v6(t->proto[r]), ip);
+    out_str(prefix);
+    const char *proto = proto_names[t->proto[r]];
+    out_pad(proto, strlen(proto), 5); out_str("  ");
+    out_u64(t->port[r], 5); out_str("  ");
+    out_pad(ip, iplen, 15); out_str("  ");
+    out_u64(t->inode[r], 10); out_str("  ");
+    if (netns_tagged()) { out_u64(g_netns[t->netns[r]].ino, 10); out_str("  "); }
+    if (g_cols & COL_RXQ) { out_u64(t->rxq ? t->rxq[r] : 0, 10); out_str("  "); }
+    if (g_cols & COL_TXQ) { out_u64(t->txq ? t->txq[r] : 0, 10); out_str("  "); }
+    if (!owners) out_str("(no owner found)");
+    bool first=true; for (const owner_info_t *o=owners;o;o=o->next) { if (owner_filtered() && !owner_matches(o->proc)) continue; if (!first) out_str(", "); first=false; out_u64((uint64_t)o->proc->pid, 0); out_char('/'); out_str(o->proc->name); print_proc_cols(o->proc); }
+    if (netns_tagged()) { out_str(" ["); out_str(g_netns[t->netns[r]].cgroup); out_char(']'); }
+    out_char('\n');
+}
+
+// --format=columnar: the printed rows as fixed-width columns, for collectors
+// that map the output and scan it rather than parse text. A header, then the
+// columns at the offsets it gives from the start of the output, each 8-byte
+// aligned:
+//   proto u8[n]      state u8[n]      port u16[n]     rport u16[n]    inode u32[n]
+//   addr u8[n][16]   raddr u8[n][16]  (network order, IPv4 in the first 4 bytes)
+//   owner_start u32[n + 1]   owner_pid i32[m]   owner_comm u32[m]
+//   comm_off u32[ncomms + 1] comms
+// with m = owner_start[n]. Row r is owned by entries owner_start[r] ..
+// owner_start[r + 1] of owner_pid and owner_comm, listed as the table lists
+// them. owner_comm indexes a dictionary of the distinct process names, name i
+// being the bytes comms[comm_off[i] .. comm_off[i + 1]). proto is the proto_t
+// number (tcp, tcp6, udp, udp6), state the kernel TCP state. Integers are in
+// host byte order, which byte_order (0x01020304) tells.
+#define COLUMNAR_MAGIC "PORTSCOL"
+#define COLUMNAR_VERSION 1u
+
+typedef struct {
+    char magic[8];
+    uint32_t version, byte_order;
+    uint32_t nrows, nowners, ncomms, comms_len;
+    uint64_t off_proto, off_state, off_port, off_rport, off_inode, off_addr, off_raddr;
+    uint64_t off_owner_start, off_owner_pid, off_owner_comm, off_comm_off, off_comms, size;
+} columnar_header_t;
+
+static bool owner_printed(const owner_info_t *o) { return !owner_filtered() || owner_matches(o->proc); }
+
+// dictionary id of name, added if new; slots is open addressing over names[]
+typedef struct { const char **names; uint32_t *slots; size_t n, mask; uint64_t len; } comm_dict_t;
+
+static uint32_t comm_dict_id(comm_dict_t *d, const char *name) {
+    uint64_t h = 1469598103934665603ull;  // FNV-1a
+    for (const char *c = name; *c; ++c) h = (h ^ (unsigned char)*c) * 1099511628211ull;
+    size_t i = (size_t)h & d->mask;
+    for (; d->slots[i]; i = (i + 1) & d->mask)
+        if (strcmp(d->names[d->slots[i] - 1], name) == 0) return d->slots[i] - 1;
+    d->names[d->n] = name;
+    d->len += strlen(name);
+    d->slots[i] = (uint32_t)++d->n;
+    return (uint32_t)(d->n - 1);
+}
+
+static void out_zeros(size_t n) { while (n--) out_char(0); }
+
+#define COLUMNAR_COL(off, count, size) (h.off = pos, pos = (pos + (uint64_t)(count) * (size) + 7) & ~7ull)
+#define COLUMNAR_ALIGN() out_zeros((size_t)(-at & 7)), at = (at + 7) & ~7ull
+#define COLUMNAR_PUT(v) do { __typeof__(v) v_ = (v); memcpy(out_room(sizeof(v_)), &v_, sizeof(v_)); g_out_len += sizeof(v_); at += sizeof(v_); } while (0)
+
+static void print_columnar(const sock_table_t *t, const uint32_t *order, size_t n) {
+    uint32_t *rows = malloc((n ? n : 1) * sizeof(*rows));
+    if (!rows) return;
+    size_t nrows = 0, nowners = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!row_matches(t, order[i])) continue;
+        rows[nrows++] = order[i];
+        for (const owner_info_t *o = t->owners[order[i]]; o; o = o->next) nowners += owner_printed(o);
+    }
+    // every owner may bring a new name
+    size_t cap = 16; while (cap < 2 * nowners) cap <<= 1;
+    comm_dict_t dict = { malloc((nowners ? nowners : 1) * sizeof(char *)), calloc(cap, sizeof(uint32_t)), 0, cap - 1, 0 };
+    uint32_t *comm = malloc((nowners ? nowners : 1) * sizeof(*comm));
+    if (!dict.names || !dict.slots || !comm) { free(rows); free(dict.names); free(dict.slots); free(comm); return; }
+    size_t m = 0;
+    for (size_t i = 0; i < nrows; ++i)
+        for (const owner_info_t *o = t->owners[rows[i]]; o; o = o->next)
+            if (owner_printed(o)) comm[m++] = comm_dict_id(&dict, o->proc->name);
+
+    columnar_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, COLUMNAR_MAGIC, 8);
+    h.version = COLUMNAR_VERSION;
+    h.byte_order = 0x01020304u;
+    h.nrows = (uint32_t)nrows; h.nowners = (uint32_t)nowners; h.ncomms = (uint32_t)dict.n; h.comms_len = (uint32_t)dict.len;
+    uint64_t pos = (sizeof(h) + 7) & ~7ull, at = 0;
+    COLUMNAR_COL(off_proto, nrows, 1); COLUMNAR_COL(off_state, nrows, 1);
+    COLUMNAR_COL(off_port, nrows, 2); COLUMNAR_COL(off_rport, nrows, 2); COLUMNAR_COL(off_inode, nrows, 4);
+    COLUMNAR_COL(off_addr, nrows, 16); COLUMNAR_COL(off_raddr, nrows, 16);
+    COLUMNAR_COL(off_owner_start, nrows + 1, 4); COLUMNAR_COL(off_owner_pid, nowners, 4); COLUMNAR_COL(off_owner_comm, nowners, 4);
+    COLUMNAR_COL(off_comm_off, dict.n + 1, 4); COLUMNAR_COL(off_comms, dict.len, 1);
+    h.size = pos;
+
+    out_mem((const char *)&h, sizeof(h)); at = sizeof(h); COLUMNAR_ALIGN();
+    for (size_t i = 0; i < nrows; ++i) COLUMNAR_PUT(t->proto[rows[i]]);
+    COLUMNAR_ALIGN();
+    for (size_t i = 0; i < nrows; ++i) COLUMNAR_PUT(t->state[rows[i]]);
+    COLUMNAR_ALIGN();
+    for (size_t i = 0; i < nrows; ++i) COLUMNAR_PUT(t->port[rows[i]]);
+    COLUMNAR_ALIGN();
+    for (size_t i = 0; i < nrows; ++i) COLUMNAR_PUT(t->rport[rows[i]]);
+    COLUMNAR_ALIGN();
+    for (size_t i = 0; i < nrows; ++i) COLUMNAR_PUT(t->inode[rows[i]]);
+    COLUMNAR_ALIGN();
+    for (size_t i = 0; i < nrows; ++i) { memcpy(out_room(16), t->addr[rows[i]], 16); g_out_len += 16; at += 16; }
+    for (size_t i = 0; i < nrows; ++i) { memcpy(out_room(16), t->raddr[rows[i]], 16); g_out_len += 16; at += 16; }
+    uint32_t start = 0;
+    for (size_t i = 0; i < nrows; ++i) {
+        COLUMNAR_PUT(start);
+        for (const owner_info_t *o = t->owners[rows[i]]; o; o = o->next) start += owner_printed(o);
+    }
+    COLUMNAR_PUT(start);
+    COLUMNAR_ALIGN();
+    for (size_t i = 0; i < nrows; ++i)
+        for (const owner_info_t *o = t->owners[rows[i]]; o; o = o->next)
+            if (owner_printed(o)) COLUMNAR_PUT((int32_t)o->proc->pid);
+    COLUMNAR_ALIGN();
+    for (size_t i = 0; i < nowners; ++i) COLUMNAR_PUT(comm[i]);
+    COLUMNAR_ALIGN();
+    uint32_t off = 0;
+    for (size_t i = 0; i < dict.n; ++i) { COLUMNAR_PUT(off); off += (uint32_t)strlen(dict.names[i]); }
+    COLUMNAR_PUT(off);
+    COLUMNAR_ALIGN();
+    for (size_t i = 0; i < dict.n; ++i) { size_t l = strlen(dict.names[i]); out_mem(dict.names[i], l); at += l; }
+    COLUMNAR_ALIGN();
+    out_flush();
+    free(rows); free(dict.names); free(dict.slots); free(comm);
+}
+#undef COLUMNAR_COL
+#undef COLUMNAR_ALIGN
+#undef COLUMNAR_PUT
+
+// -j prints one array; its rows are still written (and flushed) one by one
+static void print_table(const sock_table_t *t, const uint32_t *order, size_t n) {
+    if (g_format == FORMAT_COLUMNAR) { print_columnar(t, order, n); return; }
+    print_header();
+    bool first = true;
+    if (g_format == FORMAT_JSON) out_char('[');
+    for (size_t i=0;i<n;++i) {
+        if (!row_matches(t, order[i])) continue;
+        if (g_format == FORMAT_JSON) out_str(first ? "\n" : ",\n");
+        first = false;
+        print_row(t, order[i], "");
+    }
+    if (g_format == FORMAT_JSON) out_str(first ? "]\n" : "\n]\n");
+    out_flush();
+}
+
+// Sorting works on packed keys: the sort fields of a row are folded into one
+// integer (its bits reversed for -r), and the (key, row) pairs are radix
+// sorted, least significant byte first. That is stable, so rows with equal
+// keys keep table order, and costs a few linear passes instead of a
+// comparator call per comparison. With --limit only the first N pairs are
+// wanted; they are picked with a bounded max-heap and only those are sorted.
+typedef struct { uint64_t key; uint32_t row; } sort_item_t;
+
+// -s pid keys on the smallest owner pid that would be printed; rows without
+// one sort after every owned row
+static uint64_t row_sort_key(const sock_table_t *t, uint32_t r) {
+    uint64_t port = t->port[r], proto = t->proto[r], k;
+    switch (g_sort_field) {
+    case SORT_PROTO: k = proto << 16 | port; break;
+    case SORT_PID: {
+        uint64_t pid = UINT32_MAX;
+        for (const owner_info_t *o = t->owners[r]; o; o = o->next)
+            if ((!owner_filtered() || owner_matches(o->proc)) && (uint64_t)o->proc->pid < pid) pid = (uint64_t)o->proc->pid;
+        k = pid << 24 | port << 8 | proto;
+        break; }
+    default: k = port << 8 | proto; break;
+    }
+    return g_sort_reverse ? ~k : k;
+}
+
+// stable LSD radix sort on key; bytes on which every key agrees are skipped
+static void radix_sort_items(sort_item_t *a, size_t n) {
+    if (n < 2) return;
+    sort_item_t *tmp = malloc(n * sizeof(*tmp));
+    if (!tmp) return;
+    size_t count[8][256] = {{0}};
+    for (size_t i = 0; i < n; ++i)
+        for (int b = 0; b < 8; ++b) count[b][(a[i].key >> (8 * b)) & 0xff]++;
+    sort_item_t *src = a, *dst = tmp;
+    for (int b = 0; b < 8; ++b) {
+        if (count[b][(a[0].key >> (8 * b)) & 0xff] == n) continue;
+        size_t at = 0;
+        for (int d = 0; d < 256; ++d) { size_t c = count[b][d]; count[b][d] = at; at += c; }
+        for (size_t i = 0; i < n; ++i) dst[count[b][(src[i].key >> (8 * b)) & 0xff]++] = src[i];
+        sort_item_t *s = src; src = dst; dst = s;
+    }
+    if (src != a) memcpy(a, src, n * sizeof(*a));
+    free(tmp);
+}
+
+static inline bool item_before(const sort_item_t *x, const sort_item_t *y) {
+    return x->key != y->key ? x->key < y->key : x->row < y->row;
+}
+
+static void heap_sift_down(sort_item_t *h, size_t n, size_t i) {
+    for (;;) {
+        size_t l = 2 * i + 1, big = i;
+        if (l < n && item_before(&h[big], &h[l])) big = l;
+        if (l + 1 < n && item_before(&h[big], &h[l + 1])) big = l + 1;
+        if (big == i) return;
+        sort_item_t s = h[i]; h[i] = h[big]; h[big] = s;
+        i = big;
+    }
+}
+
+// order[0..*n) is in table order; sort it and keep the first limit rows (0: all)
+static void sort_rows(const sock_table_t *t, uint32_t *order, size_t *n, size_t limit) {
+    size_t m = *n, keep = limit && limit < m ? limit : m;
+    if (!keep) { *n = 0; return; }
+    if (keep < m / 8) {
+        // top-k: a max-heap of the k smallest so far, ties broken by row
+        // (= table order) so the result is the prefix a full sort would give
+        sort_item_t *h = malloc(keep * sizeof(*h));
+        if (h) {
+            for (size_t i = 0; i < m; ++i) {
+                sort_item_t it = { row_sort_key(t, order[i]), order[i] };
+                if (i < keep) {
+                    h[i] = it;
+                    if (i + 1 == keep) for (size_t j = keep / 2; j-- > 0; ) heap_sift_down(h, keep, j);
+                } else if (item_before(&it, &h[0])) { h[0] = it; heap_sift_down(h, keep, 0); }
+            }
+            // heap order -> ascending: pop the largest to the back
+            for (size_t e = keep; e > 1; --e) { sort_item_t s = h[0]; h[0] = h[e - 1]; h[e - 1] = s; heap_sift_down(h, e - 1, 0); }
+            for (size_t i = 0; i < keep; ++i) order[i] = h[i].row;
+            free(h);
+            *n = keep;
+            return;
+        }
+    }
+    sort_item_t *items = malloc(m * sizeof(*items));
+    if (!items) { *n = keep; return; }
+    for (size_t i = 0; i < m; ++i) items[i] = (sort_item_t){ row_sort_key(t, order[i]), order[i] };
+    radix_sort_items(items, m);
+    for (size_t i = 0; i < keep; ++i) order[i] = items[i].row;
+    free(items);
+    *n = keep;
+}
+
+// rows that pass the socket-field filter (-p), in table order
+static uint32_t *filter_rows(const sock_table_t *t, size_t *n) {
+    uint32_t *order = malloc((t->n ? t->n : 1) * sizeof(*order));
+    *n = 0;
+    if (!order) return NULL;
+    for (size_t i = 0; i < t->n; ++i)
+        if (g_search_port <= 0 || t->port[i] == (unsigned)g_search_port) order[(*n)++] = (uint32_t)i;
+    return order;
+}
+
+// drop the rows print_table() would skip, so --limit counts printed rows
+static void keep_matching(const sock_table_t *t, uint32_t *order, size_t *n) {
+    size_t w = 0;
+    for (size_t i = 0; i < *n; ++i)
+        if (row_matches(t, order[i])) order[w++] = order[i];
+    *n = w;
+}
+
+// whether the output order and --limit depend on owners: if not, the
+// one-shot pipeline sorts and cuts before the owner scan and only resolves
+// the rows that come out of it
+static bool order_needs_owners(void) { return g_sort_field == SORT_PID || owner_filtered(); }
+
+// the header is printed even for an empty result, which is normal with
+// kernel-side port filtering
+static void print_entries(sock_table_t *t) {
+    size_t n;
+    uint32_t *order = filter_rows(t, &n); if (!order) return;
+    keep_matching(t, order, &n);
+    sort_rows(t, order, &n, g_limit);
+    print_table(t, order, n);
+    free(order);
+}
+
+// --group-by: sockets are folded into counts per key instead of printed one
+// per row. Without an owner filter, local, remote and state keys are folded
+// while the tables are parsed (table_append diverts into t->agg), so memory
+// follows the number of distinct groups rather than of sockets. Grouping by
+// pid, or any owner filter, needs the owner scan, so those group the
+// finished table. Remote groups key on the peer address only; peer ports are
+// mostly ephemeral.
+
+static inline size_t group_hash(const group_key_t *k) {
+    uint64_t w[3];
+    memcpy(w, k, sizeof(w));
+    uint64_t h = (w[0] * 0x9E3779B97F4A7C15ull) ^ (w[1] * 0xC2B2AE3D27D4EB4Full) ^ (w[2] * 0x165667B19E3779F9ull);
+    return (size_t)(h ^ (h >> 29));
+}
+
+static bool group_grow(group_table_t *g) {
+    size_t cap = g->slots ? 2 * (g->mask + 1) : 256;
+    group_slot_t *slots = calloc(cap, sizeof(*slots));
+    if (!slots) return false;
+    for (size_t i = 0; g->slots && i <= g->mask; ++i) {
+        if (!g->slots[i].count) continue;
+        size_t j = group_hash(&g->slots[i].key) & (cap - 1);
+        while (slots[j].count) j = (j + 1) & (cap - 1);
+        slots[j] = g->slots[i];
+    }
+    free(g->slots);
+    g->slots = slots;
+    g->mask = cap - 1;
+    return true;
+}
+
+static bool group_add(group_table_t *g, const group_key_t *k, const proc_info_t *proc) {
+    if ((g->n + 1) * 2 > (g->slots ? g->mask + 1 : 0) && !group_grow(g))
+        return false;
+    size_t i = group_hash(k) & g->mask;
+    while (g->slots[i].count && memcmp(&g->slots[i].key, k, sizeof(*k)) != 0) i = (i + 1) & g->mask;
+    if (!g->slots[i].count) { g->slots[i].key = *k; g->slots[i].proc = proc; ++g->n; }
+    ++g->slots[i].count;
+    ++g->rows;
+    return true;
+}
+
+static bool group_row(group_table_t *g, proto_t proto, uint8_t state, const uint8_t addr[16], uint16_t port, const uint8_t raddr[16]) {
+    group_key_t k;
+    memset(&k, 0, sizeof(k));
+    k.proto = (uint8_t)proto;
+    switch (g_group_by) {
+    case GROUP_LOCAL: memcpy(k.addr, addr, 16); k.port = port; break;
+    case GROUP_REMOTE: memcpy(k.addr, raddr, 16); break;
+    case GROUP_STATE: k.state = state; break;
+    default: return false;  // pid groups come from group_table_rows()
+    }
+    return group_add(g, &k, NULL);
+}
+
+// fold the listed rows of an owner-resolved table; a pid group counts every
+// socket the process holds, sockets without an owner share pid 0
+static void group_table_rows(group_table_t *g, const sock_table_t *t, const uint32_t *order, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t r = order[i];
+        if (!row_matches(t, r)) continue;
+        if (g_group_by != GROUP_PID) { group_row(g, t->proto[r], t->state[r], t->addr[r], t->port[r], t->raddr[r]); continue; }
+        group_key_t k;
+        memset(&k, 0, sizeof(k));
+        bool any = false;
+        for (const owner_info_t *o = t->owners[r]; o; o = o->next) {
+            if (owner_filtered() && !owner_matches(o->proc)) continue;
+            k.pid = o->proc->pid;
+            group_add(g, &k, o->proc);
+            any = true;
+        }
+        if (!any) { k.pid = 0; group_add(g, &k, NULL); }
+    }
+}
+
+// largest groups first (-r: smallest), ties in key order
+static int cmp_groups(const void *a, const void *b) {
+    const group_slot_t *x = *(const group_slot_t *const *)a, *y = *(const group_slot_t *const *)b;
+    int r = x->count != y->count ? (x->count > y->count ? -1 : 1) : 0;
+    if (!r) r = (x->key.proto > y->key.proto) - (x->key.proto < y->key.proto);
+    if (!r) r = (x->key.port > y->key.port) - (x->key.port < y->key.port);
+    if (!r) r = (x->key.state > y->key.state) - (x->key.state < y->key.state);
+    if (!r) r = (x->key.pid > y->key.pid) - (x->key.pid < y->key.pid);
+    if (!r) r = memcmp(x->key.addr, y->key.addr, 16);
+    return g_sort_reverse ? -r : r;
+}
+
+static void print_group(const group_slot_t *s) {
+    char ip[INET6_ADDRSTRLEN];
+    const char *proto = proto_names[s->key.proto];
+    size_t iplen = format_addr(s->key.addr, proto_is_v6(s->key.proto), ip);
+    if (g_format != FORMAT_TABLE) {
+        switch (g_group_by) {
+        case GROUP_LOCAL:
+            out_str("{\"proto\":\""); out_str(proto); out_str("\",\"address\":\""); out_mem(ip, iplen);
+            out_str("\",\"port\":"); out_u64(s->key.port, 0);
+            break;
+        case GROUP_REMOTE:
+            out_str("{\"proto\":\""); out_str(proto); out_str("\",\"remote_address\":\""); out_mem(ip, iplen); out_char('"');
+            break;
+        case GROUP_STATE:
+            out_str("{\"proto\":\""); out_str(proto); out_str("\",\"state\":\""); out_str(state_name(s->key.state)); out_char('"');
+            break;
+        default:
+            if (!s->proc) { out_str("{\"pid\":null,\"name\":null"); break; }
+            out_str("{\"pid\":"); out_u64((uint64_t)s->key.pid, 0); out_str(",\"name\":"); out_json_str(s->proc->name);
+            break;
+        }
+        out_str(",\"sockets\":"); out_u64(s->count, 0); out_char('}');
+        if (g_format == FORMAT_NDJSON) out_char('\n');
+        return;
+    }
+    switch (g_group_by) {
+    case GROUP_LOCAL:
+        out_pad(proto, strlen(proto), 5); out_str("  "); out_u64(s->key.port, 5); out_str("  "); out_pad(ip, iplen, 15);
+        break;
+    case GROUP_REMOTE:
+        out_pad(proto, strlen(proto), 5); out_str("  "); out_pad(ip, iplen, 15);
+        break;
+    case GROUP_STATE: {
+        const char *st = state_name(s->key.state);
+        out_pad(proto, strlen(proto), 5); out_str("  "); out_pad(st, strlen(st), 12);
+        break; }
+    default: {
+        const char *name = s->proc ? s->proc->name : "(no owner found)";
+        if (s->proc) out_u64((uint64_t)s->key.pid, 7);
+        else out_pad("-", 1, 7);
+        out_str("  "); out_pad(name, strlen(name), 15);
+        break; }
+    }
+    out_str("  "); out_u64(s->count, 0); out_char('\n');
+}
+
+static void print_groups(const group_table_t *g) {
+    static const char *const headers[][2] = {
+        [GROUP_LOCAL]  = { "Proto  Port   Local IP         Sockets\n", "-----  -----  ---------------  -------\n" },
+        [GROUP_REMOTE] = { "Proto  Remote IP        Sockets\n",        "-----  ---------------  -------\n" },
+        [GROUP_PID]    = { "PID      Process          Sockets\n",       "-------  ---------------  -------\n" },
+        [GROUP_STATE]  = { "Proto  State         Sockets\n",           "-----  ------------  -------\n" },
+    };
+    const group_slot_t **list = malloc((g->n ? g->n : 1) * sizeof(*list));
+    if (!list) return;
+    size_t n = 0;
+    for (size_t i = 0; g->slots && i <= g->mask; ++i)
+        if (g->slots[i].count) list[n++] = &g->slots[i];
+    qsort(list, n, sizeof(*list), cmp_groups);
+    if (g_limit && n > g_limit) n = g_limit;
+    if (g_format == FORMAT_TABLE) { out_str(headers[g_group_by][0]); out_str(headers[g_group_by][1]); }
+    if (g_format == FORMAT_JSON) out_char('[');
+    for (size_t i = 0; i < n; ++i) {
+        if (g_format == FORMAT_JSON) out_str(i ? ",\n" : "\n");
+        print_group(list[i]);
+    }
+    if (g_format == FORMAT_JSON) out_str(n ? "\n]\n" : "]\n");
+    out_flush();
+    free(list);
+}
+
+static void free_groups(group_table_t *g) { free(g->slots); memset(g, 0, sizeof(*g)); }
+
+// read the socket tables: prefer netlink sock_diag, fall back to the
+// /proc/net text tables per file. Default: only listening sockets (TCP 0A,
+// UDP 07); all with -a.
+// mask selects the protocols (PROTO_MASK_*) to read.
+// base is the proc directory whose net/ is read: the proc root for our own
+// namespace, <root>/<pid> for another one; netlink asks the calling thread's namespace
+static void collect_net(sock_table_t *t, unsigned mask, const char *base, bool netlink) {
+    static const struct { const char *path; proto_t proto; int family, protocol; } tables[] = {
+        { "net/tcp",  PROTO_TCP,  AF_INET,  IPPROTO_TCP },
+        { "net/tcp6", PROTO_TCP6, AF_INET6, IPPROTO_TCP },
+        { "net/udp",  PROTO_UDP,  AF_INET,  IPPROTO_UDP },
+        { "net/udp6", PROTO_UDP6, AF_INET6, IPPROTO_UDP },
+    };
+    for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); ++i) {
+        if (!(mask & (1u << tables[i].proto)))
+            continue;
+        if (stream_full(t))
+            break;
+        if (netlink && parse_sock_diag(t, tables[i].family, tables[i].protocol, tables[i].proto, !g_show_all, g_search_port, 0))
+            continue;
+        char path[512]; snprintf(path, sizeof(path), "%s/%s", base, tables[i].path);
+        parse_proc_net(t, path, tables[i].proto, !g_show_all, g_search_port);
+    }
+}
+
+// The tables don't depend on each other, so each is read by a thread of its
+// own into a private table, appended in tcp, tcp6, udp, udp6 order after all
+// are done. Folding into groups while parsing (t->agg) is what bounds the
+// memory of --group-by, so that case reads them one after another, as does
+// a single CPU.
+typedef struct { sock_table_t table; unsigned mask; bool netlink; pthread_t thread; bool started; } net_reader_t;
+
+static void *net_reader_run(void *arg) {
+    net_reader_t *r = arg;
+    collect_net(&r->table, r->mask, g_proc_root, r->netlink);
+    return NULL;
+}
+
+static void collect_sockets(sock_table_t *t, unsigned mask) {
+    // netlink always reports the live kernel, so a fixture root uses the text parser
+    bool netlink = strcmp(g_proc_root, "/proc") == 0;
+    if (t->agg || __builtin_popcount(mask) < 2 || sysconf(_SC_NPROCESSORS_ONLN) < 2) { collect_net(t, mask, g_proc_root, netlink); return; }
+
+    net_reader_t readers[4];
+    memset(readers, 0, sizeof(readers));
+    for (int p = 0; p < 4; ++p) {
+        if (!(mask & (1u << p))) continue;
+        readers[p].mask = 1u << p;
+        readers[p].netlink = netlink;
+        readers[p].started = pthread_create(&readers[p].thread, NULL, net_reader_run, &readers[p]) == 0;
+    }
+    for (int p = 0; p < 4; ++p) {
+        if (!readers[p].mask) continue;
+        if (readers[p].started) pthread_join(readers[p].thread, NULL);
+        else net_reader_run(&readers[p]);
+        table_concat(t, &readers[p].table);
+        free_entries(&readers[p].table);
+    }
+}
+
+// --stream: rows are printed straight from the parsers, in table order, and
+// the table never holds more than one batch of them. The owners come first:
+// the fd walk (or the kernel iterator) records every socket fd as a packed
+// inode << 32 | process pair, sorted, so the owners of a row are one binary
+// search away the moment it is parsed. Memory is those 8 bytes per socket fd,
+// one batch and the output buffer, instead of a row per socket plus the
+// sort arrays; the price is that nothing is sorted.
+typedef struct stream_sink {
+    uint64_t *owners; size_t nowners;  // inode << 32 | index into procs, ascending
+    proc_info_t **procs;
+    uint64_t rows;                     // rows handed out by stream_flush()
+    size_t printed;                    // --limit
+    bool full;                         // --limit reached: the collectors stop reading
+    bool first;                        // JSON: no comma before the first object
+} stream_sink_t;
+
+static uint64_t stream_rows(const sock_table_t *t) { return t->sink ? t->sink->rows : 0; }
+static bool stream_full(const sock_table_t *t) { return t->sink && t->sink->full; }
+
+static void radix_sort_u64(uint64_t *a, size_t n) {
+    uint64_t *tmp = n > 1 ? malloc(n * sizeof(*tmp)) : NULL;
+    if (!tmp) return;
+    uint64_t *src = a, *dst = tmp;
+    for (int b = 0; b < 8; ++b) {
+        size_t count[256] = {0};
+        for (size_t i = 0; i < n; ++i) count[src[i] >> (8 * b) & 0xff]++;
+        if (count[src[0] >> (8 * b) & 0xff] == n) continue;
+        for (size_t d = 0, at = 0; d < 256; ++d) { size_t c = count[d]; count[d] = at; at += c; }
+        for (size_t i = 0; i < n; ++i) dst[count[src[i] >> (8 * b) & 0xff]++] = src[i];
+        uint64_t *x = src; src = dst; dst = x;
+    }
+    if (src != a) memcpy(a, src, n * sizeof(*a));
+    free(tmp);
+}
+
+// print the batch with its owners and empty the table
+static void stream_flush(sock_table_t *t) {
+    stream_sink_t *s = t->sink;
+    for (size_t r = 0; r < t->n && !(g_limit && s->printed >= g_limit); ++r) {
+        uint64_t lo = 0, hi = s->nowners, key = (uint64_t)t->inode[r] << 32;
+        while (t->inode[r] && lo < hi) { uint64_t mid = lo + (hi - lo) / 2; if (s->owners[mid] < key) lo = mid + 1; else hi = mid; }
+        // ascending process order and prepending add_owner() give the lists of populate_owners()
+        for (; t->inode[r] && lo < s->nowners && s->owners[lo] >> 32 == t->inode[r]; ++lo) {
+            add_owner(t, r, s->procs[(uint32_t)s->owners[lo]]);
+            if (g_first_owner) break;
+        }
+        if (!row_matches(t, (uint32_t)r)) continue;
+        if (g_format == FORMAT_JSON) out_str(s->first ? "\n" : ",\n");
+        s->first = false;
+        print_row(t, (uint32_t)r, "");
+        ++s->printed;
+    }
+    s->rows += t->n;
+    s->full = g_limit && s->printed >= g_limit;
+    t->n = 0;
+    arena_free(&t->arena);
+}
+
+// a full batch is printed; with --limit, so are the rows as soon as they
+// could reach it, which lets the readers stop right there. Rows read after
+// that are only dropped, a batch at a time
+static void stream_row_added(sock_table_t *t) {
+    stream_sink_t *s = t->sink;
+    if (t->n >= STREAM_BATCH || (g_limit && !s->full && s->printed + t->n >= g_limit)) stream_flush(t);
+}
+
+// every socket fd as an owner pair; the process records go to *procs
+static bool stream_owners(stream_sink_t *s, proc_info_t **procs) {
+    pid_scan_t *res = NULL;
+    pid_t *pids = NULL;
+    size_t nres = 0;
+    if (strcmp(g_proc_root, "/proc") == 0 && iter_scan(NULL, NULL, &res, &nres))
+        cache_unused("the bpf iterator finds the owners without walking /proc");
+    else {
+        nres = list_pids(&pids);
+        if (!(res = calloc(nres ? nres : 1, sizeof(*res)))) { free(pids); return false; }
+        if (g_cache_path) cache_open();
+        scan_pids(NULL, NULL, pids, nres, res, g_jobs);
+        if (g_cache_path) { cache_save(pids, res, nres); cache_close(); }
+    }
+    size_t n = 0;
+    for (size_t k = 0; k < nres; ++k) n += res[k].n;
+    s->owners = malloc((n ? n : 1) * sizeof(*s->owners));
+    s->procs = calloc(nres ? nres : 1, sizeof(*s->procs));
+    for (size_t k = 0; k < nres; ++k) {
+        pid_scan_t *r = &res[k];
+        stats_merge(&g_stats, &r->st);
+        for (size_t m = 0; s->owners && m < r->n; ++m) s->owners[s->nowners++] = (uint64_t)r->match[m] << 32 | k;
+        if (r->proc) { r->proc->next = *procs; *procs = r->proc; }
+        if (s->procs) s->procs[k] = r->proc;
+        free(r->match);
+    }
+    free(res);
+    free(pids);
+    if (!s->owners || !s->procs) return false;
+    radix_sort_u64(s->owners, s->nowners);
+    return true;
+}
+
+static int stream_report(void) {
+    stream_sink_t sink = { .first = true };
+    proc_info_t *procs = NULL;
+    stamp_t st = stamp_now();
+    bool ok = stream_owners(&sink, &procs);
+    stage_done(STAGE_OWNERS, st);
+    if (!ok) { fprintf(stderr, "out of memory\n"); free(sink.owners); free(sink.procs); free_procs(procs); return 1; }
+
+    // the parse stage includes printing: rows leave as they are read
+    st = stamp_now();
+    sock_table_t t = { .sink = &sink };
+    print_header();
+    if (g_format == FORMAT_JSON) out_char('[');
+    collect_net(&t, PROTO_MASK_ALL, g_proc_root, strcmp(g_proc_root, "/proc") == 0);
+    stream_flush(&t);
+    if (g_format == FORMAT_JSON) out_str(sink.first ? "]\n" : "\n]\n");
+    out_flush();
+    fflush(stdout);
+    g_stats.sockets = sink.rows;
+    stage_done(STAGE_PARSE, st);
+
+    free_entries(&t);
+    free(sink.owners);
+    free(sink.procs);
+    free_procs(procs);
+    return 0;
+}
+
+// --all-netns: every distinct network namespace is found through the
+// /proc/<pid>/ns/net links and read once, by a pool of threads. A worker
+// enters the namespace with setns() and asks netlink, or, without the
+// privilege for that, parses /proc/<pid>/net/* of a process inside it.
+// Socket inodes are global, so all namespaces end up in one table and a
+// single owner scan serves them all.
+typedef struct { netns_info_t *ns; sock_table_t *tables; size_t n; atomic_size_t next; bool may_enter; } netns_ctx_t;
+
+static int cmp_netns(const void *a, const void *b) {
+    const netns_info_t *x = a, *y = b;
+    if (x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+    return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+// one record per namespace, for its lowest pid; sorted by namespace inode
+static size_t discover_netns(netns_info_t **out) {
+    *out = NULL;
+    pid_t *pids;
+    size_t npids = list_pids(&pids), n = 0;
+    int dirfd = open(g_proc_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    netns_info_t *all = npids ? calloc(npids, sizeof(*all)) : NULL;
+    for (size_t k = 0; all && dirfd >= 0 && k < npids; ++k) {
+        char rel[32], link[64];
+        snprintf(rel, sizeof(rel), "%d/ns/net", (int)pids[k]);
+        ssize_t len = readlinkat(dirfd, rel, link, sizeof(link) - 1);
+        if (len <= 0) { if (len < 0 && errno == EACCES) g_stats.eacces++; continue; }
+        link[len] = 0;
+        unsigned long long ino;
+        if (sscanf(link, "net:[%llu]", &ino) != 1) continue;
+        all[n].ino = ino;
+        all[n++].pid = pids[k];
+    }
+    if (dirfd >= 0) close(dirfd);
+    free(pids);
+    if (!n) { free(all); return 0; }
+
+    qsort(all, n, sizeof(*all), cmp_netns);
+    size_t w = 0;
+    for (size_t i = 0; i < n; ++i)
+        if (!w || all[i].ino != all[w - 1].ino) all[w++] = all[i];
+    for (size_t i = 0; i < w; ++i) read_cgroup(all[i].pid, all[i].cgroup, sizeof(all[i].cgroup));
+    *out = all;
+    return w;
+}
+
+static void *netns_worker(void *arg) {
+    netns_ctx_t *ctx = arg;
+    // the way back into our own namespace after visiting one
+    int home = ctx->may_enter ? open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC) : -1;
+    for (size_t i; (i = atomic_fetch_add(&ctx->next, 1)) < ctx->n; ) {
+        char base[4096], path[4200];
+        snprintf(base, sizeof(base), "%s/%d", g_proc_root, (int)ctx->ns[i].pid);
+        bool entered = false;
+        if (home >= 0) {
+            snprintf(path, sizeof(path), "%s/ns/net", base);
+            int fd = open(path, O_RDONLY | O_CLOEXEC);
+            entered = fd >= 0 && setns(fd, CLONE_NEWNET) == 0;
+            if (fd >= 0) close(fd);
+        }
+        collect_net(&ctx->tables[i], PROTO_MASK_ALL, base, entered);
+        // stranded in a foreign namespace: the text tables still work from anywhere
+        if (entered && setns(home, CLONE_NEWNET) != 0) { close(home); home = -1; }
+    }
+    if (home >= 0) close(home);
+    return NULL;
+}
+
+static void collect_all_netns(sock_table_t *t) {
+    free(g_netns);
+    g_nnetns = discover_netns(&g_netns);
+    sock_table_t *tables = g_nnetns ? calloc(g_nnetns, sizeof(*tables)) : NULL;
+    if (!tables) { g_nnetns = 0; collect_sockets(t, PROTO_MASK_ALL); return; }  // e.g. a fixture without ns links
+
+    netns_ctx_t ctx = { g_netns, tables, g_nnetns, 0, strcmp(g_proc_root, "/proc") == 0 };
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nthreads = cpus > 0 ? (size_t)cpus : 1, started = 0;
+    if (nthreads > g_nnetns) nthreads = g_nnetns;
+    // workers switch namespaces, which the calling thread must never do, so
+    // they all get threads of their own
+    pthread_t *threads = calloc(nthreads, sizeof(*threads));
+    for (size_t k = 0; threads && k < nthreads; ++k)
+        if (pthread_create(&threads[started], NULL, netns_worker, &ctx) == 0) ++started;
+    for (size_t k = 0; k < started; ++k) pthread_join(threads[k], NULL);
+    free(threads);
+    if (!started) { ctx.may_enter = false; netns_worker(&ctx); }
+
+    for (size_t i = 0; i < g_nnetns; ++i) {
+        for (size_t r = 0; r < tables[i].n; ++r)
+            if (table_copy_row(t, &tables[i], r) && !t->agg) t->netns[t->n - 1] = (uint32_t)i;
+        free_entries(&tables[i]);
+    }
+    free(tables);
+}
+
+// print the rows listed in order[] sorted like the main table, with a prefix
+static void print_changes(const sock_table_t *t, uint32_t *order, size_t n, const char *prefix) {
+    sort_rows(t, order, &n, 0);
+    for (size_t i = 0; i < n; ++i)
+        if (row_matches(t, order[i])) print_row(t, order[i], prefix);
+    out_flush();
+}
+
+// drop owner records that no row of the current table references any more
+static void sweep_procs(proc_info_t **procs, const sock_table_t *t, unsigned gen) {
+    for (size_t r = 0; r < t->n; ++r)
+        for (owner_info_t *o = t->owners[r]; o; o = o->next) o->proc->gen = gen;
+    for (proc_info_t **pp = procs; *pp; ) {
+        proc_info_t *p = *pp;
+        if (p->gen != gen) { *pp = p->next; proc_info_free(p); }
+        else pp = &p->next;
+    }
+}
+
+// long-running modes keep one resident table and mark vanished rows dead by
+// clearing their inode. Compaction squeezes those rows out and moves the
+// surviving owner lists into a fresh arena, so churn can't grow memory.
+static void table_compact(sock_table_t *t) {
+    arena_t fresh = {0};
+    size_t w = 0;
+    for (size_t r = 0; r < t->n; ++r) {
+        if (!t->inode[r])
+            continue;
+        t->proto[w] = t->proto[r];
+        t->state[w] = t->state[r];
+        memcpy(t->addr[w], t->addr[r], 16);
+        t->port[w] = t->port[r];
+        memcpy(t->raddr[w], t->raddr[r], 16);
+        t->rport[w] = t->rport[r];
+        t->inode[w] = t->inode[r];
+        t->netns[w] = t->netns[r];
+        t->cookie[w] = t->cookie[r];
+        if (t->rxq) { t->rxq[w] = t->rxq[r]; t->txq[w] = t->txq[r]; }
+        owner_info_t **tail = &t->owners[w];
+        const owner_info_t *o = t->owners[r];
+        *tail = NULL;
+        for (; o; o = o->next) {
+            owner_info_t *n = arena_alloc(&fresh, sizeof(*n));
+            if (!n) break;
+            n->proc = o->proc; n->next = NULL;
+            *tail = n; tail = &n->next;
+        }
+        ++w;
+    }
+    t->n = w;
+    arena_free(&t->arena);
+    t->arena = fresh;
+}
+
+// resolve owners for rows[0..n) of t, or for the whole table when rows is NULL
+static void resolve_rows(sock_table_t *t, const uint32_t *rows, size_t n, proc_info_t **procs) {
+    if (rows && !n) return;
+    inode_index_t idx;
+    build_inode_index(&idx, t, rows, n);
+    populate_owners(t, &idx, procs, g_jobs);
+    free_inode_index(&idx);
+}
+
+// merge a fresh snapshot into the resident table, matching rows on
+// (proto, inode). Rows of cur that aren't resident are appended, get their
+// owners resolved (the only /proc/<pid>/fd walk) and are printed with "+";
+// resident rows of the protocols in mask that are missing from cur are
+// printed with "-" and dropped (printing only if report). Sockets without an
+// inode are not tracked.
+static void merge_snapshot(sock_table_t *res, const sock_table_t *cur, unsigned mask, proc_info_t **procs, bool report) {
+    inode_index_t cur_idx, res_idx;
+    build_inode_index(&cur_idx, cur, NULL, 0);
+    build_inode_index(&res_idx, res, NULL, 0);
+    uint32_t *gone = malloc((res->n ? res->n : 1) * sizeof(*gone));
+    uint32_t *added = malloc((cur->n ? cur->n : 1) * sizeof(*added));
+    if (!gone || !added) goto out;
+
+    size_t ngone = 0, nadded = 0;
+    for (size_t r = 0; r < res->n; ++r)
+        if (res->inode[r] && (mask & (1u << res->proto[r])) && inode_index_find(&cur_idx, cur, res->proto[r], res->inode[r]) < 0)
+            gone[ngone++] = (uint32_t)r;
+    for (size_t c = 0; c < cur->n; ++c) {
+        long have = cur->inode[c] ? inode_index_find(&res_idx, res, cur->proto[c], cur->inode[c]) : -1;
+        if (have >= 0) {
+            res->state[have] = cur->state[c];  // e.g. SYN_SENT -> ESTABLISHED
+            if (res->rxq && cur->rxq) { res->rxq[have] = cur->rxq[c]; res->txq[have] = cur->txq[c]; }
+        }
+        if (!cur->inode[c] || have >= 0)
+            continue;
+        if (table_copy_row(res, cur, c))
+            added[nadded++] = (uint32_t)(res->n - 1);
+    }
+
+    resolve_rows(res, added, nadded, procs);
+    if (report) {
+        print_changes(res, gone, ngone, "- ");
+        print_changes(res, added, nadded, "+ ");
+        fflush(stdout);
+    }
+
+    for (size_t k = 0; k < ngone; ++k) res->inode[gone[k]] = 0;
+    if (ngone) table_compact(res);
+out:
+    free(gone);
+    free(added);
+    free_inode_index(&cur_idx);
+    free_inode_index(&res_idx);
+}
+
+static void sleep_interval(double interval) {
+    struct timespec ts = { (time_t)interval, (long)((interval - (time_t)interval) * 1e9) };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) ;
+}
+
+// initial snapshot shared by the long-running modes: full table, all owners
+static void load_resident(sock_table_t *res, proc_info_t **procs) {
+    collect_sockets(res, PROTO_MASK_ALL);
+    resolve_rows(res, NULL, 0, procs);
+    print_entries(res);
+    fflush(stdout);
+    table_compact(res);  // drop the untracked inode-0 rows
+}
+
+// -w: print the full table once, then only the sockets that appeared (+) or
+// disappeared (-) since the previous tick. The previous table stays resident
+// and owners are carried over for known sockets, so /proc/<pid>/fd is only
+// walked when unseen inodes show up.
+static int watch(double interval) {
+    sock_table_t res = {0};
+    proc_info_t *procs = NULL;
+    unsigned gen = 0;
+
+    load_resident(&res, &procs);
+    for (;;) {
+        sleep_interval(interval);
+        sock_table_t cur = {0};
+        collect_sockets(&cur, PROTO_MASK_ALL);
+        merge_snapshot(&res, &cur, PROTO_MASK_ALL, &procs, true);
+        free_entries(&cur);
+        sweep_procs(&procs, &res, ++gen);
+    }
+    free_entries(&res);
+    free_procs(procs);
+    return 1;
+}
+
+// socket cookie -> resident row, for destroy notifications (which carry the
+// cookie but no inode). Rows marked dead stay in the index until the next
+// rebuild; lookups skip them by checking the row itself.
+typedef struct { uint64_t *keys; uint32_t *rows; size_t mask, n; } cookie_index_t;
+
+static void cookie_index_free(cookie_index_t *ci) { free(ci->keys); free(ci->rows); memset(ci, 0, sizeof(*ci)); }
+
+static void cookie_index_put(cookie_index_t *ci, uint64_t cookie, uint32_t row) {
+    size_t i = inode_hash((unsigned long)(cookie ^ (cookie >> 32))) & ci->mask;
+    while (ci->keys[i]) i = (i + 1) & ci->mask;
+    ci->keys[i] = cookie; ci->rows[i] = row; ci->n++;
+}
+
+static void cookie_index_build(cookie_index_t *ci, const sock_table_t *t) {
+    cookie_index_free(ci);
+    size_t cap = 64; while (cap < 2 * t->n + 2) cap <<= 1;
+    ci->keys = calloc(cap, sizeof(*ci->keys));
+    ci->rows = calloc(cap, sizeof(*ci->rows));
+    if (!ci->keys || !ci->rows) { cookie_index_free(ci); return; }
+    ci->mask = cap - 1;
+    for (size_t r = 0; r < t->n; ++r)
+        if (t->inode[r] && t->cookie[r]) cookie_index_put(ci, t->cookie[r], (uint32_t)r);
+}
+
+static void cookie_index_add(cookie_index_t *ci, const sock_table_t *t, uint32_t row) {
+    if (!t->cookie[row]) return;
+    if (!ci->keys || 2 * (ci->n + 1) > ci->mask + 1) { cookie_index_build(ci, t); return; }
+    cookie_index_put(ci, t->cookie[row], row);
+}
+
+static long cookie_index_find(const cookie_index_t *ci, const sock_table_t *t, uint64_t cookie) {
+    if (!ci->keys || !cookie) return -1;
+    for (size_t i = inode_hash((unsigned long)(cookie ^ (cookie >> 32))) & ci->mask; ci->keys[i]; i = (i + 1) & ci->mask)
+        if (ci->keys[i] == cookie && t->cookie[ci->rows[i]] == cookie && t->inode[ci->rows[i]])
+            return ci->rows[i];
+    return -1;
+}
+
+// subscribe to the sock_diag destroy multicast groups (needs CAP_NET_ADMIN)
+static int open_destroy_listener(void) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_SOCK_DIAG);
+    if (fd < 0)
+        return -1;
+    int rcvbuf = 4 << 20;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0)
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    sa.nl_groups = (1u << (SKNLGRP_INET_TCP_DESTROY - 1)) | (1u << (SKNLGRP_INET_UDP_DESTROY - 1)) |
+                   (1u << (SKNLGRP_INET6_TCP_DESTROY - 1)) | (1u << (SKNLGRP_INET6_UDP_DESTROY - 1));
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) { close(fd); return -1; }
+    return fd;
+}
+
+// eBPF tracepoint on sock:inet_sock_set_state, loaded with raw bpf(2) calls.
+// The program copies the state change, the current pid and comm into a ring
+// buffer; for listen() and connect() the current task is the socket's owner,
+// so those sockets are attributed without walking /proc at all.
+typedef struct {
+    uint32_t pid;
+    int32_t oldstate, newstate;
+    uint16_t sport, dport, family, protocol;
+    uint8_t saddr[4];
+    uint8_t saddr_v6[16];
+    char comm[16];
+} tp_event_t;
+
+typedef struct { int prog_fd, map_fd, perf_fd; void *cons, *prod; size_t size, page; } tp_watch_t;
+
+#define TP_RINGBUF_SIZE (1u << 20)
+#define TCP_SYN_SENT_STATE 2
+#define TCP_CLOSE_STATE    7
+
+// offset of a field in a tracefs event "format" description, or -1
+static int tp_field_offset(const char *fmt, const char *name, int want_size) {
+    size_t nl = strlen(name);
+    for (const char *p = strstr(fmt, "field:"); p; p = strstr(p + 1, "field:")) {
+        const char *semi = strchr(p, ';');
+        if (!semi) break;
+        const char *q = semi;  // name ends at ';' or '['
+        for (const char *b = p; b < semi; ++b) if (*b == '[') { q = b; break; }
+        if ((size_t)(q - p) < nl || strncmp(q - nl, name, nl) != 0 || (q[-(long)nl - 1] != ' ' && q[-(long)nl - 1] != '*')) continue;
+        const char *o = strstr(semi, "offset:"), *z = strstr(semi, "size:");
+        if (!o || !z) break;
+        return atoi(z + 5) == want_size ? atoi(o + 7) : -1;
+    }
+    return -1;
+}
+
+static char *read_small_file(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    size_t cap = 8192, n = 0;
+    char *buf = malloc(cap);
+    ssize_t r;
+    while (buf && (r = read(fd, buf + n, cap - n - 1)) > 0) {
+        n += (size_t)r;
+        if (n + 1 == cap) { char *nb = realloc(buf, cap *= 2); if (!nb) { free(buf); buf = NULL; } else buf = nb; }
+    }
+    close(fd);
+    if (buf) buf[n] = 0;
+    return buf;
+}
+
+// read a file below tracefs. If tracefs is not mounted anywhere, mount it in
+// a private mount namespace of our own so the host's mount table is left alone.
+static char *read_tracefs(const char *rel) {
+    static const char *const roots[] = { "/sys/kernel/tracing", "/sys/kernel/debug/tracing" };
+    static bool mounted = false;
+    char path[256];
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        for (size_t i = 0; i < 2; ++i) {
+            snprintf(path, sizeof(path), "%s/%s", roots[i], rel);
+            char *buf = read_small_file(path);
+            if (buf) return buf;
+        }
+        if (mounted || unshare(CLONE_NEWNS) < 0 || mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) < 0 ||
+            mount("tracefs", roots[0], "tracefs", 0, NULL) < 0)
+            break;
+        mounted = true;
+    }
+    return NULL;
+}
+
+static void tp_watch_close(tp_watch_t *w) {
+    if (w->cons) munmap(w->cons, w->page);
+    if (w->prod) munmap(w->prod, w->page + 2 * w->size);
+    if (w->perf_fd >= 0) close(w->perf_fd);
+    if (w->prog_fd >= 0) close(w->prog_fd);
+    if (w->map_fd >= 0) close(w->map_fd);
+    memset(w, 0, sizeof(*w));
+    w->prog_fd = w->map_fd = w->perf_fd = -1;
+}
+
+static bool tp_watch_open(tp_watch_t *w, bool only_listen) {
+    memset(w, 0, sizeof(*w));
+    w->prog_fd = w->map_fd = w->perf_fd = -1;
+
+    char *fmt = read_tracefs("events/sock/inet_sock_set_state/format");
+    char *id = fmt ? read_tracefs("events/sock/inet_sock_set_state/id") : NULL;
+    if (!fmt || !id) { free(fmt); free(id); return false; }
+    int tp_id = atoi(id);
+    int o_old = tp_field_offset(fmt, "oldstate", 4), o_new = tp_field_offset(fmt, "newstate", 4);
+    int o_sport = tp_field_offset(fmt, "sport", 2), o_dport = tp_field_offset(fmt, "dport", 2);
+    int o_family = tp_field_offset(fmt, "family", 2), o_proto = tp_field_offset(fmt, "protocol", 2);
+    int o_saddr = tp_field_offset(fmt, "saddr", 4), o_saddr6 = tp_field_offset(fmt, "saddr_v6", 16);
+    free(fmt); free(id);
+    if (o_old < 0 || o_new < 0 || o_sport < 0 || o_dport < 0 || o_family < 0 || o_proto < 0 || o_saddr < 0 || o_saddr6 < 0 || o_saddr6 % 8)
+        return false;
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_RINGBUF;
+    attr.max_entries = TP_RINGBUF_SIZE;
+    w->map_fd = (int)sys_bpf(BPF_MAP_CREATE, &attr);
+    if (w->map_fd < 0) { tp_watch_close(w); return false; }
+
+    // r6 = ctx; event is built on the stack at r10 + S
+    enum { S = -(int)sizeof(tp_event_t) };
+    struct bpf_insn prog[64];
+    int n = 0, jumps[4], nj = 0;
+    prog[n++] = I_MOV_REG(BPF_REG_6, BPF_REG_1);
+    prog[n++] = I_LDX(BPF_H, BPF_REG_2, BPF_REG_6, o_proto);
+    jumps[nj++] = n; prog[n++] = I_JNE_IMM(BPF_REG_2, IPPROTO_TCP, 0);
+    if (only_listen) {
+        prog[n++] = I_LDX(BPF_W, BPF_REG_2, BPF_REG_6, o_new);
+        jumps[nj++] = n; prog[n++] = I_JNE_IMM(BPF_REG_2, TCP_LISTEN_STATE, 0);
+    }
+    prog[n++] = I_CALL(BPF_FUNC_get_current_pid_tgid);
+    prog[n++] = I_RSH_IMM(BPF_REG_0, 32);
+    prog[n++] = I_STX(BPF_W, BPF_REG_10, BPF_REG_0, S + (int)offsetof(tp_event_t, pid));
+    const struct { int sz, from, to; } copies[] = {
+        { BPF_W,  o_old,        offsetof(tp_event_t, oldstate) },
+        { BPF_W,  o_new,        offsetof(tp_event_t, newstate) },
+        { BPF_H,  o_sport,      offsetof(tp_event_t, sport) },
+        { BPF_H,  o_dport,      offsetof(tp_event_t, dport) },
+        { BPF_H,  o_family,     offsetof(tp_event_t, family) },
+        { BPF_H,  o_proto,      offsetof(tp_event_t, protocol) },
+        { BPF_W,  o_saddr,      offsetof(tp_event_t, saddr) },
+        { BPF_DW, o_saddr6,     offsetof(tp_event_t, saddr_v6) },
+        { BPF_DW, o_saddr6 + 8, offsetof(tp_event_t, saddr_v6) + 8 },
+    };
+    for (size_t i = 0; i < sizeof(copies) / sizeof(copies[0]); ++i) {
+        prog[n++] = I_LDX(copies[i].sz, BPF_REG_2, BPF_REG_6, copies[i].from);
+        prog[n++] = I_STX(copies[i].sz, BPF_REG_10, BPF_REG_2, S + copies[i].to);
+    }
+    prog[n++] = I_MOV_REG(BPF_REG_1, BPF_REG_10);
+    prog[n++] = I_ADD_IMM(BPF_REG_1, S + (int)offsetof(tp_event_t, comm));
+    prog[n++] = I_MOV_IMM(BPF_REG_2, 16);
+    prog[n++] = I_CALL(BPF_FUNC_get_current_comm);
+    prog[n++] = BPF_INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, w->map_fd);
+    prog[n++] = BPF_INSN(0, 0, 0, 0, 0);
+    prog[n++] = I_MOV_REG(BPF_REG_2, BPF_REG_10);
+    prog[n++] = I_ADD_IMM(BPF_REG_2, S);
+    prog[n++] = I_MOV_IMM(BPF_REG_3, sizeof(tp_event_t));
+    prog[n++] = I_MOV_IMM(BPF_REG_4, 0);
+    prog[n++] = I_CALL(BPF_FUNC_ringbuf_output);
+    int out = n;
+    prog[n++] = I_MOV_IMM(BPF_REG_0, 0);
+    prog[n++] = I_EXIT();
+    for (int j = 0; j < nj; ++j) prog[jumps[j]].off = (short)(out - jumps[j] - 1);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_TRACEPOINT;
+    attr.insns = (uint64_t)(uintptr_t)prog;
+    attr.insn_cnt = (uint32_t)n;
+    attr.license = (uint64_t)(uintptr_t)"Dual MIT/GPL";
+    w->prog_fd = (int)sys_bpf(BPF_PROG_LOAD, &attr);
+    if (w->prog_fd < 0) { tp_watch_close(w); return false; }
+
+    struct perf_event_attr pa;
+    memset(&pa, 0, sizeof(pa));
+    pa.type = PERF_TYPE_TRACEPOINT;
+    pa.size = sizeof(pa);
+    pa.config = (uint64_t)tp_id;
+    pa.sample_period = 1;
+    pa.wakeup_events = 1;
+    w->perf_fd = (int)syscall(__NR_perf_event_open, &pa, -1, 0, -1, PERF_FLAG_FD_CLOEXEC);
+    if (w->perf_fd < 0 || ioctl(w->perf_fd, PERF_EVENT_IOC_SET_BPF, w->prog_fd) < 0 || ioctl(w->perf_fd, PERF_EVENT_IOC_ENABLE, 0) < 0) {
+        tp_watch_close(w); return false;
+    }
+
+    w->page = (size_t)sysconf(_SC_PAGESIZE);
+    w->size = TP_RINGBUF_SIZE;
+    w->cons = mmap(NULL, w->page, PROT_READ | PROT_WRITE, MAP_SHARED, w->map_fd, 0);
+    if (w->cons == MAP_FAILED) { w->cons = NULL; tp_watch_close(w); return false; }
+    w->prod = mmap(NULL, w->page + 2 * w->size, PROT_READ, MAP_SHARED, w->map_fd, (off_t)w->page);
+    if (w->prod == MAP_FAILED) { w->prod = NULL; tp_watch_close(w); return false; }
+    return true;
+}
+
+// drain the ring buffer into ev[], at most max events
+static size_t tp_watch_drain(tp_watch_t *w, tp_event_t *ev, size_t max) {
+    unsigned long *consp = w->cons, *prodp = w->prod;
+    const char *data = (const char *)w->prod + w->page;
+    unsigned long cons = __atomic_load_n(consp, __ATOMIC_ACQUIRE);
+    unsigned long prod = __atomic_load_n(prodp, __ATOMIC_ACQUIRE);
+    size_t n = 0;
+    while (cons < prod && n < max) {
+        const uint32_t *hdr = (const uint32_t *)(data + (cons & (w->size - 1)));
+        uint32_t len = __atomic_load_n(hdr, __ATOMIC_ACQUIRE);
+        if (len & BPF_RINGBUF_BUSY_BIT)
+            break;
+        uint32_t sz = len & ~(BPF_RINGBUF_BUSY_BIT | BPF_RINGBUF_DISCARD_BIT);
+        if (!(len & BPF_RINGBUF_DISCARD_BIT) && sz == sizeof(*ev))
+            memcpy(&ev[n++], (const char *)hdr + BPF_RINGBUF_HDR_SZ, sizeof(*ev));
+        cons += (sz + BPF_RINGBUF_HDR_SZ + 7) & ~7ul;
+    }
+    __atomic_store_n(consp, cons, __ATOMIC_RELEASE);
+    return n;
+}
+
+// a tracepoint event says a TCP socket changed state: fetch the sockets for
+// that port pair from the kernel and add the ones not yet resident. Sockets
+// created by listen()/connect() are attributed to the event's task by
+// scanning only that pid; the rest fall back to an owner scan.
+static void apply_tp_event(sock_table_t *res, cookie_index_t *ci, const tp_event_t *ev, proc_info_t **procs) {
+    if (ev->newstate == TCP_CLOSE_STATE)
+        return; // removals arrive as destroy notifications
+    if (g_search_port > 0 && ev->sport != (unsigned)g_search_port)
+        return;
+    int family = ev->family == AF_INET6 ? AF_INET6 : AF_INET;
+    proto_t proto = family == AF_INET6 ? PROTO_TCP6 : PROTO_TCP;
+    bool process_ctx = ev->newstate == TCP_LISTEN_STATE || ev->newstate == TCP_SYN_SENT_STATE;
+
+    sock_table_t tmp = {0};
+    parse_sock_diag(&tmp, family, IPPROTO_TCP, proto, !g_show_all, ev->sport, g_show_all ? ev->dport : 0);
+    uint32_t *added = malloc((tmp.n ? tmp.n : 1) * sizeof(*added));
+    size_t nadded = 0;
+    for (size_t r = 0; added && r < tmp.n; ++r) {
+        // inode 0: connection not accept()ed yet; the reconcile pass picks it up
+        if (!tmp.inode[r] || cookie_index_find(ci, res, tmp.cookie[r]) >= 0)
+            continue;
+        if (!table_copy_row(res, &tmp, r))
+            continue;
+        cookie_index_add(ci, res, (uint32_t)(res->n - 1));
+        added[nadded++] = (uint32_t)(res->n - 1);
+    }
+    free_entries(&tmp);
+
+    if (nadded && process_ctx && ev->pid) {
+        inode_index_t idx;
+        build_inode_index(&idx, res, added, nadded);
+        pid_scan_t r = {0};
+        scan_pid_fds(&idx, NULL, (pid_t)ev->pid, &r);
+        apply_pid_scan(res, &r, procs);
+        free_inode_index(&idx);
+    }
+    size_t nmiss = 0;
+    uint32_t *miss = malloc((nadded ? nadded : 1) * sizeof(*miss));
+    for (size_t k = 0; miss && k < nadded; ++k)
+        if (!res->owners[added[k]]) miss[nmiss++] = added[k];
+    if (miss) resolve_rows(res, miss, nmiss, procs);
+    free(miss);
+
+    if (added) print_changes(res, added, nadded, "+ ");
+    free(added);
+}
+
+// handle the pending destroy notifications; returns false if some were lost
+static bool drain_destroy_events(int fd, sock_table_t *res, const cookie_index_t *ci, size_t *ndead) {
+    char buf[1 << 16];
+    for (;;) {
+        ssize_t len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            return errno != ENOBUFS; // socket overrun: events were dropped
+        }
+        for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, (size_t)len); h = NLMSG_NEXT(h, len)) {
+            if (h->nlmsg_type != SOCK_DIAG_BY_FAMILY || h->nlmsg_len < NLMSG_LENGTH(sizeof(struct inet_diag_msg))) continue;
+            long r = cookie_index_find(ci, res, diag_cookie(NLMSG_DATA(h)));
+            if (r < 0) continue;
+            if (row_matches(res, (uint32_t)r)) print_row(res, (uint32_t)r, "- ");
+            res->inode[r] = 0;
+            ++*ndead;
+        }
+    }
+}
+
+static double now_monotonic(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// -e: event-driven variant of -w. Removals come from sock_diag destroy
+// notifications and new TCP sockets from the inet_sock_set_state tracepoint,
+// both as they happen. A reconcile snapshot every `interval` seconds covers
+// what has no event source (new UDP sockets, accepted connections once they
+// get an inode) and anything missed when a source is unavailable.
+static int follow(double interval) {
+    sock_table_t res = {0};
+    proc_info_t *procs = NULL;
+    cookie_index_t ci = {0};
+    unsigned gen = 0;
+    size_t ndead = 0;
+
+    load_resident(&res, &procs);
+    cookie_index_build(&ci, &res);
+
+    int dfd = open_destroy_listener();
+    tp_watch_t tp;
+    bool have_tp = tp_watch_open(&tp, !g_show_all);
+    // in LISTEN mode the tracepoint sees every new TCP socket
+    unsigned reconcile_mask = (have_tp && !g_show_all) ? PROTO_MASK_UDP : PROTO_MASK_ALL;
+    tp_event_t ev[256];
+    double next = now_monotonic() + interval;
+
+    for (;;) {
+        struct pollfd pfd[2];
+        int npfd = 0;
+        if (dfd >= 0) pfd[npfd++] = (struct pollfd){ .fd = dfd, .events = POLLIN };
+        if (have_tp) pfd[npfd++] = (struct pollfd){ .fd = tp.map_fd, .events = POLLIN };
+        double wait = next - now_monotonic();
+        int timeout = wait > 0 ? (int)(wait * 1000) + 1 : 0;
+        if (poll(pfd, npfd, timeout) < 0 && errno != EINTR)
+            break;
+
+        bool lost = false;
+        if (dfd >= 0 && !drain_destroy_events(dfd, &res, &ci, &ndead))
+            lost = true;
+        if (have_tp) {
+            size_t n;
+            while ((n = tp_watch_drain(&tp, ev, sizeof(ev) / sizeof(ev[0]))) > 0)
+                for (size_t i = 0; i < n; ++i) apply_tp_event(&res, &ci, &ev[i], &procs);
+        }
+
+        if (lost || now_monotonic() >= next) {
+            sock_table_t cur = {0};
+            unsigned mask = lost ? PROTO_MASK_ALL : reconcile_mask;
+            collect_sockets(&cur, mask);
+            merge_snapshot(&res, &cur, mask, &procs, true);
+            free_entries(&cur);
+            next = now_monotonic() + interval;
+            ndead = res.n; // force the compaction below
+        }
+        if (ndead && 2 * ndead >= res.n) {
+            table_compact(&res);
+            cookie_index_build(&ci, &res);
+            sweep_procs(&procs, &res, ++gen);
+            ndead = 0;
+        }
+        out_flush();
+        fflush(stdout);
+    }
+
+    if (have_tp) tp_watch_close(&tp);
+    if (dfd >= 0) close(dfd);
+    cookie_index_free(&ci);
+    free_entries(&res);
+    free_procs(procs);
+    return 1;
+}
+
+// --daemon: one resident table of every socket in every state, refreshed
+// every interval like -w, and queries answered on a Unix socket so that many
+// callers share a single scan. A query is one line of space-separated words
+//   [all=1] [port=N] [pid=N] [sort=port|proto|pid] [reverse=1] [limit=N]
+//   [format=table|json|ndjson] [name=TEXT]
+// where name= takes the rest of the line; no words is the default LISTEN
+// table. The answer starts with "ok" or "error <reason>" on a line of its
+// own, then the table exactly as the CLI prints it, and the daemon closes
+// the connection. The socket is created 0600, so only root and the
+// daemon's own user can query; PORTS_SOCKET overrides the path, and an
+// empty PORTS_SOCKET disables both sides.
+#define DAEMON_SOCKET_DEFAULT "/run/ports.sock"
+#define DAEMON_MAX_QUERY 16384  // room for a few hundred name= patterns
+#define DAEMON_MAX_PENDING 32   // clients whose query is still arriving; more wait in the backlog
+
+static const char *daemon_socket_path(void) {
+    const char *p = getenv("PORTS_SOCKET");
+    return p ? p : DAEMON_SOCKET_DEFAULT;
+}
+
+static int daemon_connect(const char *path) {
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    if (!*path || strlen(path) >= sizeof(sa.sun_path)) return -1;
+    strcpy(sa.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) { close(fd); return -1; }
+    return fd;
+}
+
+static void set_io_timeout(int fd, int seconds) {
+    struct timeval tv = { seconds, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+// the query words set the same globals as the matching CLI flags
+static const char *apply_query(char *line) {
+    for (char *w = line; *w; ) {
+        while (*w == ' ') ++w;
+        if (!*w) break;
+        if (strncmp(w, "name=", 5) == 0) {
+            // several patterns are separated by tabs
+            for (char *p = w + 5; p; ) {
+                char *tab = strchr(p, '\t');
+                if (tab) *tab++ = 0;
+                if (!name_add(&g_names, p)) return "out of memory";
+                p = tab;
+            }
+            break;
+        }
+        char *end = w + strcspn(w, " ");
+        if (*end) *end++ = 0;
+        char *val = strchr(w, '=');
+        if (!val) return "malformed word";
+        *val++ = 0;
+        if (strcmp(w, "all") == 0) g_show_all = atoi(val) != 0;
+        else if (strcmp(w, "port") == 0) g_search_port = atoi(val);
+        else if (strcmp(w, "pid") == 0) g_search_pid = (pid_t)atoi(val);
+        else if (strcmp(w, "regex") == 0) g_names.regex = atoi(val) != 0;
+        else if (strcmp(w, "reverse") == 0) g_sort_reverse = atoi(val) != 0;
+        else if (strcmp(w, "limit") == 0) g_limit = (size_t)strtoul(val, NULL, 10);
+        else if (strcmp(w, "format") == 0) {
+            if ((g_format = parse_format(val)) == FORMAT_COUNT) { g_format = FORMAT_TABLE; return "unknown format"; }
+        }
+        else if (strcmp(w, "sort") == 0) {
+            if (strcmp(val, "port") == 0) g_sort_field = SORT_PORT;
+            else if (strcmp(val, "proto") == 0) g_sort_field = SORT_PROTO;
+            else if (strcmp(val, "pid") == 0) g_sort_field = SORT_PID;
+            else return "unknown sort";
+        } else return "unknown key";
+        w = end;
+    }
+    char msg[128];
+    static char bad_regex[160];
+    if (!name_compile(&g_names, msg, sizeof(msg))) { snprintf(bad_regex, sizeof(bad_regex), "bad name pattern: %s", msg); return bad_regex; }
+    return NULL;
+}
+
+// a connection whose query line is read as poll() reports data, so a client
+// that connects and sends nothing never holds up a refresh or other clients
+typedef struct { int fd; size_t len; double deadline; char line[DAEMON_MAX_QUERY]; } daemon_client_t;
+
+// one read() of a readable client; true once its query is complete or the
+// client stopped sending
+static bool client_read(daemon_client_t *c) {
+    ssize_t r = read(c->fd, c->line + c->len, sizeof(c->line) - 1 - c->len);
+    if (r < 0) return errno != EINTR && errno != EAGAIN;
+    if (r == 0) return true;
+    c->len += (size_t)r;
+    return c->len == sizeof(c->line) - 1 || memchr(c->line, '\n', c->len);
+}
+
+// answer the query read so far and close the connection
+static void serve_client(daemon_client_t *c, sock_table_t *res) {
+    int cfd = c->fd;
+    char *line = c->line;
+    line[c->len] = 0;
+    line[strcspn(line, "\r\n")] = 0;
+
+    // each query starts from the CLI defaults; the daemon's own state is put back after
+    bool show_all = g_show_all; int port = g_search_port; pid_t pid = g_search_pid; name_matcher_t names = g_names;
+    sort_field_t sort = g_sort_field; bool reverse = g_sort_reverse; out_format_t format = g_format; size_t limit = g_limit;
+    g_show_all = false; g_search_port = 0; g_search_pid = 0; memset(&g_names, 0, sizeof(g_names)); g_sort_field = SORT_PORT; g_sort_reverse = false;
+    g_format = FORMAT_TABLE; g_limit = 0;
+
+    FILE *out = fdopen(cfd, "w");
+    if (!out) close(cfd);
+    const char *err = out ? apply_query(line) : NULL;
+    if (err) fprintf(out, "error %s\n", err);
+    else if (out) {
+        fputs("ok\n", out);
+        FILE *saved = stdout;
+        stdout = out;
+        print_entries(res);
+        fflush(out);
+        stdout = saved;
+    }
+    if (out) fclose(out);
+
+    name_free(&g_names);
+    g_show_all = show_all; g_search_port = port; g_search_pid = pid; g_names = names;
+    g_sort_field = sort; g_sort_reverse = reverse; g_format = format; g_limit = limit;
+}
+
+// refresh the resident table. Sockets without an inode (TIME_WAIT, pending
+// requests) can't be tracked across snapshots, so the last snapshot's are
+// dropped and the current ones appended as they are
+static void daemon_refresh(sock_table_t *res, proc_info_t **procs, unsigned gen) {
+    sock_table_t cur = {0};
+    collect_sockets(&cur, PROTO_MASK_ALL);
+    table_compact(res);
+    merge_snapshot(res, &cur, PROTO_MASK_ALL, procs, false);
+    for (size_t c = 0; c < cur.n; ++c)
+        if (!cur.inode[c]) table_copy_row(res, &cur, c);
+    free_entries(&cur);
+    sweep_procs(procs, res, gen);
+}
+
+// The daemon also publishes the resident table in a memory-mapped file
+// (/dev/shm/ports.snapshot; PORTS_SHM overrides the path, empty disables it)
+// so local readers can poll it with no IPC at all. The file has two slots.
+// Each refresh is written into the slot `current` does not point at, under
+// that slot's sequence counter, which is odd while the slot is written, and
+// then becomes current. A reader loads current and the slot's seq (retrying
+// while it is odd), copies what it needs and re-reads seq; a changed value
+// means the daemon lapped it and the copy is retried. Neither side ever
+// waits for the other. When a snapshot outgrows the slots, or the daemon
+// exits, the file is replaced (or removed) and the old one marked retired,
+// so readers reopen the path.
+//
+// A slot holds the table as columns, each at the offset its slot header
+// gives from the slot's start, 8-byte aligned:
+//   cookie u64[n]   inode u32[n]   owner_start u32[n + 1]   port u16[n]
+//   proto u8[n]     state u8[n]    addr u8[n][16] (network order)
+//   rport u16[n]    raddr u8[n][16]
+//   owner_pid i32[owner_start[n]]  procs shm_proc_t[nprocs], sorted by pid
+//   names: NUL-terminated process names, shm_proc_t.name is an offset here
+// Row r is owned by owner_pid[owner_start[r] .. owner_start[r + 1]).
+// Integers are in host byte order; the header records the interval so a
+// reader can tell a snapshot left behind by a killed daemon from a live one.
+#define SHM_PATH_DEFAULT "/dev/shm/ports.snapshot"
+#define SHM_MAGIC "PORTSSHM"
+#define SHM_VERSION 2u
+#define SHM_HEADER_SIZE 4096u
+
+typedef struct { int32_t pid; uint32_t name; } shm_proc_t;
+
+typedef struct {
+    _Atomic uint64_t seq;
+    uint64_t generation;
+    uint32_t nrows, nowners, nprocs, names_len;
+    uint64_t off_cookie, off_inode, off_owner_start, off_port, off_proto, off_state, off_addr, off_rport, off_raddr;
+    uint64_t off_owner_pid, off_procs, off_names;
+} shm_slot_hdr_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version, header_size;
+    uint64_t slot_off[2], slot_size;
+    _Atomic uint32_t current, retired;
+    _Atomic uint64_t generation;
+    _Atomic uint64_t heartbeat_ns;     // CLOCK_MONOTONIC of the last publish
+    uint64_t interval_ns;              // daemon refresh interval
+    int32_t daemon_pid;
+    shm_slot_hdr_t slots[2];
+} shm_header_t;
+
+// map is the published file; next is a replacement being filled under tmp
+typedef struct { char *map, *next; size_t size, next_size; uint64_t generation; char tmp[4096]; } shm_writer_t;
+
+static const char *shm_path(void) {
+    const char *p = getenv("PORTS_SHM");
+    return p ? p : SHM_PATH_DEFAULT;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// column offsets for a slot of n rows, m owners, p procs and len name bytes; returns the slot size
+static uint64_t shm_layout(shm_slot_hdr_t *h, size_t n, size_t m, size_t p, size_t len) {
+    uint64_t o = 0;
+#define SHM_COL(field, bytes) (h->field = o, o = (o + (uint64_t)(bytes) + 7) & ~7ull)
+    SHM_COL(off_cookie, 8 * n);
+    SHM_COL(off_inode, 4 * n);
+    SHM_COL(off_owner_start, 4 * (n + 1));
+    SHM_COL(off_port, 2 * n);
+    SHM_COL(off_proto, n);
+    SHM_COL(off_state, n);
+    SHM_COL(off_addr, 16 * n);
+    SHM_COL(off_rport, 2 * n);
+    SHM_COL(off_raddr, 16 * n);
+    SHM_COL(off_owner_pid, 4 * m);
+    SHM_COL(off_procs, sizeof(shm_proc_t) * p);
+    SHM_COL(off_names, len);
+#undef SHM_COL
+    return o;
+}
+
+static int cmp_proc_ptr(const void *a, const void *b) {
+    pid_t pa = (*(proc_info_t *const *)a)->pid, pb = (*(proc_info_t *const *)b)->pid;
+    return (pa > pb) - (pa < pb);
+}
+
+static int cmp_shm_proc(const void *a, const void *b) {
+    int32_t pa = ((const shm_proc_t *)a)->pid, pb = ((const shm_proc_t *)b)->pid;
+    return (pa > pb) - (pa < pb);
+}
+
+// a new file is filled in under a temporary name and only renamed over the
+// path once it holds a snapshot, so a reader never opens an empty one
+static bool shm_create(shm_writer_t *w, uint64_t slot_size, double interval) {
+    snprintf(w->tmp, sizeof(w->tmp), "%s.%d", shm_path(), (int)getpid());
+    unlink(w->tmp);
+    slot_size = (slot_size + 4095) & ~4095ull;
+    size_t size = SHM_HEADER_SIZE + 2 * slot_size;
+    int fd = open(w->tmp, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    char *map = ftruncate(fd, (off_t)size) == 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) { unlink(w->tmp); return false; }
+    shm_header_t *h = (shm_header_t *)map;
+    memcpy(h->magic, SHM_MAGIC, 8);
+    h->version = SHM_VERSION;
+    h->header_size = SHM_HEADER_SIZE;
+    h->slot_off[0] = SHM_HEADER_SIZE;
+    h->slot_off[1] = SHM_HEADER_SIZE + slot_size;
+    h->slot_size = slot_size;
+    h->interval_ns = (uint64_t)(interval * 1e9);
+    h->daemon_pid = (int32_t)getpid();
+    w->next = map;
+    w->next_size = size;
+    return true;
+}
+
+static void shm_retire(char *map, size_t size) {
+    if (!map) return;
+    atomic_store(&((shm_header_t *)map)->retired, 1);
+    munmap(map, size);
+}
+
+static bool shm_publish(shm_writer_t *w, const sock_table_t *t, const proc_info_t *procs, double interval) {
+    size_t np = 0, nowners = 0, names_len = 0;
+    for (const proc_info_t *p = procs; p; p = p->next) { ++np; names_len += strlen(p->name) + 1; }
+    for (size_t r = 0; r < t->n; ++r)
+        for (const owner_info_t *o = t->owners[r]; o; o = o->next) ++nowners;
+    proc_info_t **sorted = malloc((np ? np : 1) * sizeof(*sorted));
+    if (!sorted) return false;
+    np = 0;
+    for (const proc_info_t *p = procs; p; p = p->next) sorted[np++] = (proc_info_t *)p;
+    qsort(sorted, np, sizeof(*sorted), cmp_proc_ptr);
+
+    shm_slot_hdr_t lay;
+    uint64_t need = shm_layout(&lay, t->n, nowners, np, names_len);
+    bool fresh = !w->map || need > ((shm_header_t *)w->map)->slot_size;
+    if (fresh && !shm_create(w, need * 2 > 65536 ? need * 2 : 65536, interval)) { free(sorted); return false; }
+
+    char *map = fresh ? w->next : w->map;
+    shm_header_t *h = (shm_header_t *)map;
+    uint32_t s = fresh ? 0 : 1 - atomic_load_explicit(&h->current, memory_order_relaxed);
+    shm_slot_hdr_t *sh = &h->slots[s];
+    char *base = map + h->slot_off[s];
+    uint64_t seq = atomic_load_explicit(&sh->seq, memory_order_relaxed);
+    atomic_store_explicit(&sh->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    sh->generation = ++w->generation;
+    sh->nrows = (uint32_t)t->n; sh->nowners = (uint32_t)nowners; sh->nprocs = (uint32_t)np; sh->names_len = (uint32_t)names_len;
+    sh->off_cookie = lay.off_cookie; sh->off_inode = lay.off_inode; sh->off_owner_start = lay.off_owner_start;
+    sh->off_port = lay.off_port; sh->off_proto = lay.off_proto; sh->off_state = lay.off_state; sh->off_addr = lay.off_addr;
+    sh->off_rport = lay.off_rport; sh->off_raddr = lay.off_raddr;
+    sh->off_owner_pid = lay.off_owner_pid; sh->off_procs = lay.off_procs; sh->off_names = lay.off_names;
+    memcpy(base + lay.off_cookie, t->cookie, 8 * t->n);
+    memcpy(base + lay.off_inode, t->inode, 4 * t->n);
+    memcpy(base + lay.off_port, t->port, 2 * t->n);
+    memcpy(base + lay.off_proto, t->proto, t->n);
+    memcpy(base + lay.off_state, t->state, t->n);
+    memcpy(base + lay.off_addr, t->addr, 16 * t->n);
+    memcpy(base + lay.off_rport, t->rport, 2 * t->n);
+    memcpy(base + lay.off_raddr, t->raddr, 16 * t->n);
+    uint32_t *start = (uint32_t *)(base + lay.off_owner_start);
+    int32_t *opid = (int32_t *)(base + lay.off_owner_pid);
+    uint32_t k = 0;
+    for (size_t r = 0; r < t->n; ++r) {
+        start[r] = k;
+        for (const owner_info_t *o = t->owners[r]; o; o = o->next) opid[k++] = (int32_t)o->proc->pid;
+    }
+    start[t->n] = k;
+    shm_proc_t *sp = (shm_proc_t *)(base + lay.off_procs);
+    char *names = base + lay.off_names;
+    uint32_t at = 0;
+    for (size_t i = 0; i < np; ++i) {
+        size_t L = strlen(sorted[i]->name) + 1;
+        sp[i] = (shm_proc_t){ (int32_t)sorted[i]->pid, at };
+        memcpy(names + at, sorted[i]->name, L);
+        at += (uint32_t)L;
+    }
+    free(sorted);
+
+    atomic_store_explicit(&sh->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&h->current, s, memory_order_release);
+    atomic_store_explicit(&h->generation, w->generation, memory_order_release);
+    atomic_store_explicit(&h->heartbeat_ns, monotonic_ns(), memory_order_release);
+    if (fresh) {
+        bool moved = rename(w->tmp, shm_path()) == 0;
+        if (!moved) { unlink(w->tmp); munmap(w->next, w->next_size); w->next = NULL; return false; }
+        shm_retire(w->map, w->size);
+        w->map = w->next; w->size = w->next_size; w->next = NULL;
+    }
+    return true;
+}
+
+// on exit the file goes away and anyone still mapping it is told to reopen
+static void shm_close(shm_writer_t *w) {
+    if (!w->map) return;
+    unlink(shm_path());
+    shm_retire(w->map, w->size);
+    w->map = NULL;
+}
+
+// copy the current slot into t; 1 on success, 0 if the daemon overwrote it
+// meanwhile (try again), -1 if the slot is unusable
+static int snapshot_copy(const char *map, sock_table_t *t, proc_info_t **parr) {
+    const shm_header_t *h = (const shm_header_t *)map;
+    uint32_t s = atomic_load_explicit(&h->current, memory_order_acquire);
+    if (s > 1) return -1;
+    const shm_slot_hdr_t *sh = &h->slots[s];
+    uint64_t seq = atomic_load_explicit(&sh->seq, memory_order_acquire);
+    if (seq & 1) return 0;
+
+    // the offsets are recomputed from the counts, so a torn header can't point outside the slot
+    size_t n = sh->nrows, m = sh->nowners, np = sh->nprocs, len = sh->names_len;
+    shm_slot_hdr_t lay;
+    if (shm_layout(&lay, n, m, np, len) > h->slot_size || !table_reserve(t, n)) return 0;
+    const char *base = map + h->slot_off[s];
+    memcpy(t->cookie, base + lay.off_cookie, 8 * n);
+    memcpy(t->inode, base + lay.off_inode, 4 * n);
+    memcpy(t->port, base + lay.off_port, 2 * n);
+    memcpy(t->proto, base + lay.off_proto, n);
+    memcpy(t->state, base + lay.off_state, n);
+    memcpy(t->addr, base + lay.off_addr, 16 * n);
+    memcpy(t->rport, base + lay.off_rport, 2 * n);
+    memcpy(t->raddr, base + lay.off_raddr, 16 * n);
+    t->n = n;
+
+    const shm_proc_t *sp = (const shm_proc_t *)(base + lay.off_procs);
+    const char *names = base + lay.off_names;
+    proc_info_t *procs = calloc(np ? np : 1, sizeof(*procs));
+    if (!procs) return -1;
+    for (size_t i = 0; i < np; ++i) {
+        procs[i].pid = sp[i].pid;
+        size_t at = sp[i].name < len ? sp[i].name : len;
+        snprintf(procs[i].name, sizeof(procs[i].name), "%.*s", (int)strnlen(names + at, len - at), names + at);
+    }
+    // owners are stored in list order; add_owner prepends, so walk them backwards
+    const uint32_t *start = (const uint32_t *)(base + lay.off_owner_start);
+    const int32_t *opid = (const int32_t *)(base + lay.off_owner_pid);
+    for (size_t r = 0; r < n; ++r) {
+        t->owners[r] = NULL;
+        uint32_t lo = start[r], hi = start[r + 1];
+        if (lo > hi || hi > m) { hi = lo = 0; }
+        for (uint32_t k = hi; k-- > lo; ) {
+            shm_proc_t key = { opid[k], 0 };
+            const shm_proc_t *hit = bsearch(&key, sp, np, sizeof(*sp), cmp_shm_proc);
+            if (hit) add_owner(t, r, &procs[hit - sp]);
+        }
+    }
+    *parr = procs;
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&sh->seq, memory_order_relaxed) != seq) {
+        arena_free(&t->arena); t->n = 0; free(procs); *parr = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+// client side: answer from the daemon's snapshot file, exactly as a local
+// scan would print. False (nothing printed) without a live snapshot.
+static bool query_snapshot(void) {
+    const char *path = shm_path();
+    if (!*path) return false;
+    sock_table_t t = {0};
+    proc_info_t *procs = NULL;
+    int got = 0;
+    // a retired file has been replaced by a bigger one: reopen the path once
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) break;
+        // /dev/shm is world-writable: only a file our user (or root) wrote,
+        // and no one else can, is trusted to stand in for the local scan
+        struct stat st;
+        bool trusted = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (st.st_uid == geteuid() || st.st_uid == 0) &&
+                       !(st.st_mode & (S_IWGRP | S_IWOTH)) && st.st_size >= (off_t)sizeof(shm_header_t);
+        char *map = trusted ? mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (map == MAP_FAILED) break;
+        const shm_header_t *h = (const shm_header_t *)map;
+        bool valid = memcmp(h->magic, SHM_MAGIC, 8) == 0 && h->version == SHM_VERSION && h->header_size == SHM_HEADER_SIZE &&
+                     h->slot_off[0] == SHM_HEADER_SIZE && h->slot_off[1] == SHM_HEADER_SIZE + h->slot_size &&
+                     SHM_HEADER_SIZE + 2 * h->slot_size <= (uint64_t)st.st_size;
+        // a daemon that missed two refreshes is gone (killed without cleaning up)
+        bool live = valid && monotonic_ns() - atomic_load_explicit(&h->heartbeat_ns, memory_order_acquire) <= 2 * h->interval_ns + 1000000000ull;
+        for (int tries = 0; live && got == 0 && tries < 8 && !atomic_load(&h->retired); ++tries)
+            got = snapshot_copy(map, &t, &procs);
+        bool retired = valid && atomic_load(&h->retired);
+        munmap(map, (size_t)st.st_size);
+        if (got != 0 || !retired) break;
+    }
+    if (got > 0) print_entries(&t);
+    free_entries(&t);
+    free(procs);
+    return got > 0;
+}
+
+static volatile sig_atomic_t g_daemon_stop = 0;
+static void daemon_stop(int sig) { (void)sig; g_daemon_stop = 1; }
+
+static int serve(double interval) {
+    const char *path = daemon_socket_path();
+    struct sockaddr_un sa = { .sun_family = AF_UNIX };
+    if (!*path || strlen(path) >= sizeof(sa.sun_path)) { fprintf(stderr, "ports: invalid daemon socket path '%s'\n", path); return 1; }
+    strcpy(sa.sun_path, path);
+
+    // a socket left by a dead daemon is replaced, a live daemon is left alone
+    int probe = daemon_connect(path);
+    if (probe >= 0) { close(probe); fprintf(stderr, "ports: a daemon is already serving %s\n", path); return 1; }
+    unlink(path);
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t old = umask(0177);
+    bool bound = lfd >= 0 && bind(lfd, (struct sockaddr *)&sa, sizeof(sa)) == 0;
+    umask(old);
+    if (!bound || listen(lfd, 64) < 0) {
+        fprintf(stderr, "ports: cannot listen on %s: %s\n", path, strerror(errno));
+        if (lfd >= 0) close(lfd);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);  // a client that hangs up mid-answer must not kill us
+    // SIGINT/SIGTERM end the loop (no SA_RESTART: poll returns) so the socket is removed
+    struct sigaction sa_stop = { .sa_handler = daemon_stop };
+    sigemptyset(&sa_stop.sa_mask);
+    sigaction(SIGINT, &sa_stop, NULL);
+    sigaction(SIGTERM, &sa_stop, NULL);
+
+    // the resident table holds everything; the filters are per query
+    g_show_all = true; g_search_port = 0; g_search_pid = 0; name_free(&g_names);
+    g_cols = 0;  // not kept by the daemon; clients with -o scan locally
+    sock_table_t res = {0};
+    proc_info_t *procs = NULL;
+    unsigned gen = 0;
+    shm_writer_t shm = {0};
+    bool publish = *shm_path() != 0;
+    daemon_refresh(&res, &procs, ++gen);
+    if (publish && !shm_publish(&shm, &res, procs, interval)) {
+        fprintf(stderr, "ports: cannot publish %s: %s\n", shm_path(), strerror(errno));
+        publish = false;
+    }
+    fprintf(stderr, "ports: serving %s%s%s, refresh every %gs\n", path, publish ? " and " : "", publish ? shm_path() : "", interval);
+
+    // the listener and every client still sending share one poll(): a query
+    // is answered as soon as its line is in, a client silent for a second
+    // with what it sent, and the refresh never waits on either
+    daemon_client_t *clients = malloc(DAEMON_MAX_PENDING * sizeof(*clients));
+    struct pollfd pfd[1 + DAEMON_MAX_PENDING];
+    for (size_t i = 0; clients && i < DAEMON_MAX_PENDING; ++i) clients[i].fd = -1;  // poll() skips negative fds
+    if (!clients) fprintf(stderr, "out of memory\n");
+    size_t npending = 0;
+    double next = now_monotonic() + interval;
+    while (clients && !g_daemon_stop) {
+        double now = now_monotonic(), wait = next - now;
+        pfd[0] = (struct pollfd){ .fd = npending < DAEMON_MAX_PENDING ? lfd : -1, .events = POLLIN };
+        for (size_t i = 0; i < DAEMON_MAX_PENDING; ++i) {
+            pfd[1 + i] = (struct pollfd){ .fd = clients[i].fd, .events = POLLIN };
+            if (clients[i].fd >= 0 && clients[i].deadline - now < wait) wait = clients[i].deadline - now;
+        }
+        int pr = poll(pfd, 1 + DAEMON_MAX_PENDING, wait > 0 ? (int)(wait * 1000) + 1 : 0);
+        if (pr < 0 && errno != EINTR) break;
+        now = now_monotonic();
+        for (size_t i = 0; i < DAEMON_MAX_PENDING; ++i) {
+            daemon_client_t *c = &clients[i];
+            if (c->fd < 0 || !((pr > 0 && pfd[1 + i].revents && client_read(c)) || now >= c->deadline)) continue;
+            serve_client(c, &res);
+            c->fd = -1;
+            --npending;
+        }
+        if (pr > 0 && (pfd[0].revents & POLLIN)) {
+            int cfd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC);
+            daemon_client_t *c = clients;
+            while (cfd >= 0 && c->fd >= 0) ++c;  // a free slot exists: lfd is only polled then
+            if (cfd >= 0) {
+                set_io_timeout(cfd, 1);  // bounds the answer, which is written blocking
+                c->fd = cfd; c->len = 0; c->deadline = now + 1;
+                ++npending;
+            }
+        }
+        if (!g_daemon_stop && now_monotonic() >= next) {
+            daemon_refresh(&res, &procs, ++gen);
+            if (publish) shm_publish(&shm, &res, procs, interval);
+            next = now_monotonic() + interval;
+        }
+    }
+    for (size_t i = 0; clients && i < DAEMON_MAX_PENDING; ++i)
+        if (clients[i].fd >= 0) close(clients[i].fd);
+    free(clients);
+    close(lfd);
+    unlink(path);
+    shm_close(&shm);
+    free_entries(&res);
+    free_procs(procs);
+    return g_daemon_stop ? 0 : 1;
+}
+
+// client side: ask a running daemon for the answer the current flags would
+// produce. False (and nothing printed) when there is no daemon or it can't
+// answer, so the caller scans locally.
+static bool query_daemon(void) {
+    int fd = daemon_connect(daemon_socket_path());
+    if (fd < 0) return false;
+    set_io_timeout(fd, 2);
+    char q[DAEMON_MAX_QUERY];
+    static const char *const sorts[] = { "port", "proto", "pid" };
+    int n = snprintf(q, sizeof(q), "all=%d port=%d pid=%d sort=%s reverse=%d limit=%zu format=%s regex=%d", g_show_all, g_search_port, (int)g_search_pid,
+                     sorts[g_sort_field], g_sort_reverse, g_limit, format_names[g_format], g_names.regex);
+    // name= comes last (it takes the rest of the line), its patterns tab separated
+    for (size_t i = 0; n >= 0 && (size_t)n < sizeof(q) && i < g_names.npats; ++i) {
+        if (strpbrk(g_names.pats[i], "\t\n")) { close(fd); return false; }
+        n += snprintf(q + n, sizeof(q) - (size_t)n, "%s%s", i ? "\t" : " name=", g_names.pats[i]);
+    }
+    if (n >= 0 && (size_t)n < sizeof(q)) n += snprintf(q + n, sizeof(q) - (size_t)n, "\n");
+    if (n < 0 || (size_t)n >= sizeof(q) || write(fd, q, (size_t)n) != n) { close(fd); return false; }
+
+    // nothing is printed until the daemon said "ok"
+    char buf[1 << 16];
+    size_t have = 0;
+    char *nl = NULL;
+    while (!nl && have < sizeof(buf)) {
+        ssize_t r = read(fd, buf + have, sizeof(buf) - have);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        have += (size_t)r;
+        nl = memchr(buf, '\n', have);
+    }
+    if (!nl || nl - buf != 2 || memcmp(buf, "ok", 2) != 0) { close(fd); return false; }
+
+    fwrite(nl + 1, 1, have - (size_t)(nl + 1 - buf), stdout);
+    ssize_t r;
+    while ((r = read(fd, buf, sizeof(buf))) > 0 || (r < 0 && errno == EINTR))
+        if (r > 0) fwrite(buf, 1, (size_t)r, stdout);
+    close(fd);
+    return true;
+}
+
+// the one-shot report main() runs once the modes and the daemon are ruled
+// out: read, filter and sort, resolve owners, print. bench/bench.c drives it
+// too, so its timings are of this control flow. g_owner_path names the owner
+// strategy taken, for the bench output.
+static const char *g_owner_path = "";
+
+static int run_report(void) {
+    sock_table_t table = {0};
+    group_table_t groups = {0};
+    bool fold_early = g_group_by != GROUP_NONE && g_group_by != GROUP_PID && !owner_filtered();
+    if (fold_early) table.agg = &groups;  // rows go straight into groups; the table stays empty
+    // the owner walk runs alongside the table reads when a full walk is coming
+    // anyway: not without owners to find, with --first-owner (it stops on the
+    // index), the kernel iterator (no walk), -p (a few rows, maybe none to scan
+    // for) or a single CPU. --cache also goes through the prescan, which is
+    // what records every socket, started at the join if not before.
+    owner_prescan_t prescan;
+    bool live = strcmp(g_proc_root, "/proc") == 0;
+    bool walk = !fold_early && !g_first_owner && !(live && iter_available());
+    bool overlap = walk && sysconf(_SC_NPROCESSORS_ONLN) > 1 && g_search_port == 0;
+    bool prescanned = overlap || (walk && g_cache_path);
+    if (prescanned && g_cache_path) cache_open();
+    else if (!prescanned)
+        cache_unused(fold_early     ? "this --group-by counts sockets without owners"
+                     : g_first_owner ? "--first-owner stops the walk before every process is recorded"
+                                     : "the bpf iterator finds the owners without walking /proc");
+    g_owner_path = fold_early ? "none (groups counted while parsing)" : g_first_owner ? "first-owner walk after the tables"
+                 : !walk ? "bpf iterator after the tables" : overlap ? "/proc walk overlapped with the tables"
+                 : prescanned ? "/proc walk after the tables, through --cache" : "/proc walk after the tables";
+    if (overlap) start_owner_prescan(&prescan, g_jobs);
+    else if (prescanned) { memset(&prescan, 0, sizeof(prescan)); prescan.nthreads = g_jobs; }
+    stamp_t st = stamp_now();
+    if (g_all_netns) collect_all_netns(&table);
+    else collect_sockets(&table, PROTO_MASK_ALL);
+    g_stats.sockets = fold_early ? groups.rows : table.n;
+    stage_done(STAGE_PARSE, st);
+
+    // filter and sort on socket fields first; owners only for what survives
+    size_t nrows;
+    bool late = order_needs_owners();
+    st = stamp_now();
+    uint32_t *order = filter_rows(&table, &nrows);
+    if (order && !late && g_group_by == GROUP_NONE) sort_rows(&table, order, &nrows, g_limit);
+    stage_done(STAGE_SORT, st);
+
+    inode_index_t idx = { NULL, 0, 0 };
+    st = stamp_now();
+    if (order) build_inode_index(&idx, &table, order, nrows);
+    stage_done(STAGE_INDEX, st);
+    proc_info_t *procs = NULL;
+    st = stamp_now();
+    if (prescanned) { join_owner_prescan(&prescan, &table, &idx, &procs); cache_close(); }
+    else populate_owners(&table, &idx, &procs, g_jobs);
+    stage_done(STAGE_OWNERS, st);
+    free_inode_index(&idx);
+
+    if (order && late && g_group_by == GROUP_NONE) {
+        st = stamp_now();
+        keep_matching(&table, order, &nrows);
+        sort_rows(&table, order, &nrows, g_limit);
+        stage_done(STAGE_SORT, st);
+    }
+
+    st = stamp_now();
+    if (g_group_by != GROUP_NONE) {
+        if (order && !fold_early) group_table_rows(&groups, &table, order, nrows);
+        print_groups(&groups);
+    } else if (order) print_table(&table, order, nrows);
+    fflush(stdout);
+    stage_done(STAGE_PRINT, st);
+    free(order);
+
+    free_groups(&groups);
+    free_entries(&table);
+    free(g_netns);
+    free_procs(procs);
+    return 0;
+}
+
+static void usage(const char *p) { fprintf(stderr, "usage: %s [-a] [-p port] [-n name]... [--regex] [-s port|pid|proto] [-r] [-j] [--format table|json|ndjson|columnar] [-o cmdline,uid,cgroup,rxq,txq] [-J [threads]] [-w interval] [-e] [--ndjson] [--group-by local|remote|pid|state] [--all-netns] [--limit N] [--pid pid] [--first-owner] [--cache path] [--stream] [--daemon] [--stats[=json]]\n"
+                                    "--daemon creates its socket and snapshot 0600: only root and the daemon's user can query them\n", p); }
+
+#ifndef PORTS_NO_MAIN
+int main(int argc, char **argv) {
+    double watch_interval = 0;
+    bool events = false, daemon_mode = false, stream = false;
+    enum { OPT_STATS = 256, OPT_FIRST_OWNER, OPT_DAEMON, OPT_PID, OPT_NDJSON, OPT_GROUP_BY, OPT_ALL_NETNS, OPT_LIMIT, OPT_CACHE, OPT_STREAM, OPT_FORMAT, OPT_REGEX };
+    static const struct option long_opts[] = {
+        { "stats", optional_argument, NULL, OPT_STATS },
+        { "first-owner", no_argument, NULL, OPT_FIRST_OWNER },
+        { "daemon", no_argument, NULL, OPT_DAEMON },
+        { "pid", required_argument, NULL, OPT_PID },
+        { "ndjson", no_argument, NULL, OPT_NDJSON },
+        { "group-by", required_argument, NULL, OPT_GROUP_BY },
+        { "all-netns", no_argument, NULL, OPT_ALL_NETNS },
+        { "limit", required_argument, NULL, OPT_LIMIT },
+        { "cache", required_argument, NULL, OPT_CACHE },
+        { "stream", no_argument, NULL, OPT_STREAM },
+        { "format", required_argument, NULL, OPT_FORMAT },
+        { "regex", no_argument, NULL, OPT_REGEX },
+        { NULL, 0, NULL, 0 },
+    };
+    int opt; while ((opt = getopt_long(argc, argv, "ap:n:s:rjo:J::w:e", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'a': g_show_all = true; break;
+        case 'p': g_search_port = atoi(optarg); break;
+        case 'n': if (!name_add(&g_names, optarg)) { fprintf(stderr, "out of memory\n"); return 1; } break;
+        case OPT_REGEX: g_names.regex = true; break;
+        case 's': if (strcmp(optarg, "port") == 0) g_sort_field = SORT_PORT; else if (strcmp(optarg, "proto") == 0) g_sort_field = SORT_PROTO; else if (strcmp(optarg, "pid") == 0) g_sort_field = SORT_PID; else { fprintf(stderr, "unknown sort: %s\n", optarg); usage(argv[0]); return 2; } break;
+        case 'r': g_sort_reverse = true; break;
+        case 'j': g_format = FORMAT_JSON; break;
+        case OPT_NDJSON: g_format = FORMAT_NDJSON; break;
+        case 'o': {
+            unsigned cols = parse_cols(optarg);
+            if (!cols) { fprintf(stderr, "unknown column in %s (cmdline, uid, cgroup, rxq or txq)\n", optarg); usage(argv[0]); return 2; }
+            g_cols |= cols;
+            break; }
+        case OPT_ALL_NETNS: g_all_netns = true; break;
+        case OPT_CACHE: g_cache_path = optarg; break;
+        case OPT_STREAM: stream = true; break;
+        case OPT_FORMAT:
+            if ((g_format = parse_format(optarg)) == FORMAT_COUNT) {
+                fprintf(stderr, "unknown format: %s (table, json, ndjson or columnar)\n", optarg); usage(argv[0]); return 2;
+            }
+            break;
+        case OPT_LIMIT: {
+            char *end = NULL; long long n = strtoll(optarg, &end, 10);
+            if (*end || n <= 0) { fprintf(stderr, "invalid limit: %s\n", optarg); usage(argv[0]); return 2; }
+            g_limit = (size_t)n;
+            break; }
+        case OPT_GROUP_BY:
+            if (strcmp(optarg, "local") == 0) g_group_by = GROUP_LOCAL;
+            else if (strcmp(optarg, "remote") == 0) g_group_by = GROUP_REMOTE;
+            else if (strcmp(optarg, "pid") == 0) g_group_by = GROUP_PID;
+            else if (strcmp(optarg, "state") == 0) g_group_by = GROUP_STATE;
+            else { fprintf(stderr, "unknown group: %s\n", optarg); usage(argv[0]); return 2; }
+            break;
+        case 'J': {
+            // -J alone (or -J 0) uses every online CPU; accept both -J4 and -J 4
+            const char *arg = optarg;
+            if (!arg && optind < argc && argv[optind][0] >= '0' && argv[optind][0] <= '9') arg = argv[optind++];
+            char *end = NULL; long n = arg ? strtol(arg, &end, 10) : 0;
+            if (arg && (*end || n < 0)) { fprintf(stderr, "invalid thread count: %s\n", arg); usage(argv[0]); return 2; }
+            if (n == 0) n = sysconf(_SC_NPROCESSORS_ONLN);
+            g_jobs = n > 0 ? (int)n : 1;
+            break; }
+        case 'e': events = true; break;
+        case OPT_FIRST_OWNER: g_first_owner = true; break;
+        case OPT_DAEMON: daemon_mode = true; break;
+        case OPT_PID: {
+            char *end = NULL; long pid = strtol(optarg, &end, 10);
+            if (*end || pid <= 0) { fprintf(stderr, "invalid pid: %s\n", optarg); usage(argv[0]); return 2; }
+            g_search_pid = (pid_t)pid;
+            break; }
+        case OPT_STATS:
+            if (!optarg || strcmp(optarg, "text") == 0) g_stats_mode = STATS_TEXT;
+            else if (strcmp(optarg, "json") == 0) g_stats_mode = STATS_JSON;
+            else { fprintf(stderr, "unknown stats format: %s\n", optarg); usage(argv[0]); return 2; }
+            break;
+        case 'w': {
+            char *end = NULL; watch_interval = strtod(optarg, &end);
+            if (*end || !(watch_interval > 0)) { fprintf(stderr, "invalid interval: %s\n", optarg); usage(argv[0]); return 2; }
+            break; }
+        default: usage(argv[0]); return 2; }
+    }
+
+    const char *root = getenv("PORTS_PROC_ROOT");
+    if (root && *root) g_proc_root = root;
+    char err[128];
+    if (!name_compile(&g_names, err, sizeof(err))) { fprintf(stderr, "invalid name pattern: %s\n", err); return 2; }
+
+    bool live = strcmp(g_proc_root, "/proc") == 0;
+    if ((g_group_by != GROUP_NONE || g_all_netns || stream) && (daemon_mode || events || watch_interval > 0)) {
+        fprintf(stderr, "%s is a one-shot report and can't be combined with -w, -e or --daemon\n", g_all_netns ? "--all-netns" : stream ? "--stream" : "--group-by");
+        return 2;
+    }
+    if (g_format == FORMAT_COLUMNAR && (stream || g_group_by != GROUP_NONE || events || watch_interval > 0)) {
+        fprintf(stderr, "--format=columnar writes one table; it can't be combined with --stream, --group-by, -w or -e\n");
+        return 2;
+    }
+    if (g_cols && (g_format == FORMAT_COLUMNAR || g_group_by != GROUP_NONE)) {
+        fprintf(stderr, "-o adds columns to rows; it can't be combined with --format=columnar or --group-by\n");
+        return 2;
+    }
+    if (stream && (g_group_by != GROUP_NONE || g_all_netns)) {
+        fprintf(stderr, "--stream prints rows unsorted and ungrouped; it can't be combined with --group-by or --all-netns\n");
+        return 2;
+    }
+    if (daemon_mode || events || watch_interval > 0) cache_unused("the watch and daemon modes keep their owners in memory");
+    if (daemon_mode)
+        return serve(watch_interval > 0 ? watch_interval : 2.0);
+    // an array can't be closed while watching, so the watch modes stream NDJSON
+    if (g_format == FORMAT_JSON && (events || watch_interval > 0)) g_format = FORMAT_NDJSON;
+    if (events)
+        return follow(watch_interval > 0 ? watch_interval : 2.0);
+    if (watch_interval > 0)
+        return watch(watch_interval);
+    if (stream) {
+        int rc = stream_report();
+        if (g_stats_mode != STATS_OFF) print_stats(stderr);
+        return rc;
+    }
+
+    // a running daemon answers from its resident table; --stats and
+    // --first-owner are about the local scan, so they always run it, and the
+    // daemon doesn't keep the -o columns
+    if (live && g_stats_mode == STATS_OFF && !g_first_owner && g_group_by == GROUP_NONE && !g_all_netns && !g_cols && (query_snapshot() || query_daemon()))
+        return 0;
+
+    int rc = run_report();
+    if (g_stats_mode != STATS_OFF)
+        print_stats(stderr);
+    return rc;
+}
+#endif
@@ -0,0 +1,194 @@
+/*
+ * check.c
+ * Tests for ports. Like bench/bench.c, ports.c is compiled into this driver
+ * (its main() is left out), so internal functions are checked directly.
+ *
+ * Usage: check [<ports binary> <fixture root>]
+ *
+ * With a binary and a gen_fixture tree it also runs the tool on the fixture
+ * and compares the table between the serial scan, -J, PORTS_NO_SIMD=1 and
+ * --stream. Each test prints one line; the exit status is the number of
+ * failed tests.
+ */
+
+#define PORTS_NO_MAIN
+#include "../ports.c"
+
+#include <ctype.h>
+#include <sys/wait.h>
+
+static int g_failed = 0;
+
+static void report(const char *name, long bad, long total) {
+    printf("%-32s %s (%ld/%ld)\n", name, bad ? "FAIL" : "ok", total - bad, total);
+    if (bad) ++g_failed;
+}
+
+// cheap deterministic PRNG (xorshift64*), as in gen_fixture
+static unsigned long long rng_state = 0x9E3779B97F4A7C15ull;
+static unsigned long long rng(void) {
+    rng_state ^= rng_state >> 12; rng_state ^= rng_state << 25; rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ull;
+}
+
+// mostly hex digits, with the bytes next to the digit and letter ranges
+// ('/', ':', '@', 'G', '`', 'g') and random ones mixed in
+static char fuzz_char(void) {
+    static const char hex[] = "0123456789abcdefABCDEF", near[] = "/:@G`g";
+    unsigned k = (unsigned)(rng() % 64);
+    if (k < 56) return hex[rng() % 22];
+    if (k < 62) return near[rng() % 6];
+    return (char)(rng() % 256);
+}
+
+// every SIMD kernel this build and CPU has must agree with the scalar one
+static void test_decode_addr_parity(void) {
+    struct { const char *name; addr_kernel_t fn; } kernels[3];
+    int nk = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1")) kernels[nk++] = (typeof(kernels[0])){ "sse4.1", decode_addr_sse };
+    if (__builtin_cpu_supports("avx2")) kernels[nk++] = (typeof(kernels[0])){ "avx2", decode_addr_avx2 };
+#elif defined(__aarch64__)
+    kernels[nk++] = (typeof(kernels[0])){ "neon", decode_addr_neon };
+#endif
+    for (int k = 0; k < nk; ++k) {
+        long bad = 0, total = 0;
+        for (int v6 = 0; v6 < 2; ++v6) {
+            for (int it = 0; it < 200000; ++it) {
+                // "ADDR:PORT " plus slack, the layout the kernels are handed
+                char buf[64];
+                size_t alen = v6 ? 32 : 8;
+                for (size_t i = 0; i < sizeof(buf); ++i) buf[i] = fuzz_char();
+                // most lines are valid, so the accepted path gets compared too
+                if (rng() % 4) for (size_t i = 0; i < alen + 5; ++i) if (!isxdigit((unsigned char)buf[i])) buf[i] = 'a';
+                buf[alen] = ':';
+                buf[alen + 5] = ' ';
+
+                uint8_t want[16], got[16];
+                uint32_t wport = 0, gport = 0;
+                bool w = decode_addr_scalar(buf, v6, want, &wport);
+                bool g = kernels[k].fn(buf, v6, got, &gport);
+                ++total;
+                if (w != g || (w && (memcmp(want, got, 16) != 0 || wport != gport))) {
+                    if (bad++ < 3) fprintf(stderr, "  %s: \"%.*s\" scalar=%d simd=%d\n", kernels[k].name, (int)alen + 5, buf, w, g);
+                }
+            }
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "decode_addr %s", kernels[k].name);
+        report(name, bad, total);
+    }
+    if (!nk) printf("%-32s skipped (no SIMD kernel)\n", "decode_addr");
+}
+
+// random addresses, biased towards zero groups so every "::" placement and
+// the IPv4-mapped and -compatible forms come up
+static void test_format_addr(void) {
+    long bad = 0, total = 0;
+    for (int it = 0; it < 200000; ++it) {
+        bool v6 = it & 1;
+        uint8_t a[16];
+        for (int w = 0; w < 8; ++w) {
+            unsigned k = (unsigned)(rng() % 4), v = k == 0 ? (unsigned)rng() & 0xffff : k == 1 ? (unsigned)rng() & 0xff : 0;
+            a[2 * w] = (uint8_t)(v >> 8); a[2 * w + 1] = (uint8_t)v;
+        }
+        if (v6 && rng() % 8 == 0) { memset(a, 0, 10); a[10] = a[11] = rng() % 2 ? 0xff : 0; }
+        char want[INET6_ADDRSTRLEN], got[INET6_ADDRSTRLEN];
+        inet_ntop(v6 ? AF_INET6 : AF_INET, a, want, sizeof(want));
+        size_t n = format_addr(a, v6, got);
+        ++total;
+        if (strcmp(want, got) != 0 || n != strlen(want)) {
+            if (bad++ < 3) fprintf(stderr, "  format_addr: inet_ntop \"%s\", got \"%s\"\n", want, got);
+        }
+    }
+    report("format_addr vs inet_ntop", bad, total);
+}
+
+// stdout of the tool run with args and the extra environment entries; NULL on failure
+static char *run_tool(const char *bin, const char *root, const char *const *args, const char *env_extra) {
+    int fds[2];
+    if (pipe(fds) < 0) return NULL;
+    pid_t pid = fork();
+    if (pid < 0) { close(fds[0]); close(fds[1]); return NULL; }
+    if (pid == 0) {
+        dup2(fds[1], 1);
+        close(fds[0]); close(fds[1]);
+        setenv("PORTS_PROC_ROOT", root, 1);
+        setenv("PORTS_SOCKET", "", 1);
+        setenv("PORTS_SHM", "", 1);
+        if (env_extra) putenv((char *)env_extra);
+        const char *argv[16] = { bin };
+        for (int i = 0; args[i] && i < 14; ++i) argv[i + 1] = args[i];
+        execv(bin, (char *const *)argv);
+        _exit(127);
+    }
+    close(fds[1]);
+    size_t len = 0, cap = 1 << 16;
+    char *buf = malloc(cap);
+    ssize_t r;
+    while (buf && (r = read(fds[0], buf + len, cap - len - 1)) != 0) {
+        if (r < 0) { if (errno == EINTR) continue; break; }
+        len += (size_t)r;
+        if (cap - len < 2) { char *nb = realloc(buf, cap *= 2); if (!nb) { free(buf); buf = NULL; } else buf = nb; }
+    }
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!buf || !WIFEXITED(status) || WEXITSTATUS(status) != 0) { free(buf); return NULL; }
+    buf[len] = 0;
+    return buf;
+}
+
+static int cmp_line(const void *a, const void *b) { return strcmp(*(char *const *)a, *(char *const *)b); }
+
+// the lines of an output sorted, for the unsorted --stream rows
+static char *sorted_lines(char *text) {
+    size_t n = 0, len = strlen(text);
+    for (char *p = text; *p; ++p) n += *p == '\n';
+    char **lines = malloc((n + 1) * sizeof(*lines)), *out = malloc(len + 1), *o = out;
+    if (!lines || !out) { free(lines); free(out); return NULL; }
+    n = 0;
+    for (char *p = text, *nl; (nl = strchr(p, '\n')); p = nl + 1) { *nl = 0; lines[n++] = p; }
+    qsort(lines, n, sizeof(*lines), cmp_line);
+    for (size_t i = 0; i < n; ++i) o += sprintf(o, "%s\n", lines[i]);
+    free(lines);
+    return out;
+}
+
+static void test_fixture(const char *bin, const char *root) {
+    static const char *const modes[] = { "default", "-a" };
+    for (int m = 0; m < 2; ++m) {
+        const char *base[] = { m ? "-a" : "-s", m ? NULL : "port", NULL };
+        const char *jobs[] = { "-J", "3", m ? "-a" : NULL, NULL };
+        const char *stream[] = { "--stream", m ? "-a" : NULL, NULL };
+        char *want = run_tool(bin, root, base, NULL);
+        // the header and at least one row, so empty outputs can't agree
+        size_t lines = 0;
+        for (const char *p = want; p && *p; ++p) lines += *p == '\n';
+        if (lines < 3) { free(want); want = NULL; }
+        char *variants[3] = { run_tool(bin, root, jobs, NULL), run_tool(bin, root, base, "PORTS_NO_SIMD=1"), run_tool(bin, root, stream, NULL) };
+        static const char *const names[3] = { "-J 3", "PORTS_NO_SIMD=1", "--stream" };
+        for (int v = 0; v < 3; ++v) {
+            char name[64];
+            snprintf(name, sizeof(name), "fixture %s %s", modes[m], names[v]);
+            bool same;
+            if (v < 2) same = want && variants[v] && strcmp(want, variants[v]) == 0;
+            else {
+                char *w = want ? strdup(want) : NULL, *a = w ? sorted_lines(w) : NULL, *b = variants[v] ? sorted_lines(variants[v]) : NULL;
+                same = a && b && strcmp(a, b) == 0;
+                free(w); free(a); free(b);
+            }
+            report(name, !same, 1);
+            free(variants[v]);
+        }
+        free(want);
+    }
+}
+
+int main(int argc, char **argv) {
+    test_decode_addr_parity();
+    test_format_addr();
+    if (argc == 3) test_fixture(argv[1], argv[2]);
+    return g_failed;
+}